@@ -0,0 +1,569 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-23 10:24:51
+ * @LastEditTime: 2026-10-27 09:12:30
+ * @Description: Headless benchmark of the loading pipeline.
+ */
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <QApplication>
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLinearGradient>
+#include <QPainter>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "config.h"
+#include "file_contents.h"
+#include "image_decoder.h"
+#include "images_carousel.h"
+#include "logger.h"
+#include "thumbnail_cache.h"
+#include "thumbnail_scaler.h"
+#include "trace.h"
+
+/**
+ * Measures the scan done by Config and the decode, scale and crop done by ImageData
+ * on a synthetic or given corpus, without showing any window.
+ *
+ *   carousel-bench [--count N] [--resolution WxH] [--format jpg|png|webp]
+ *                  [--corpus DIR] [--threads N] [--io path|read|mmap] [--cache]
+ *                  [--output csv|json] [--out FILE] [--trace FILE]
+ *   carousel-bench --verify [--count N] [--resolution WxH] [--corpus DIR]
+ *
+ * Results are written to stdout (or --out) so that runs of different versions
+ * on the same machine can be compared, logs go to stderr.
+ *
+ * --io chooses how the load stages get the file contents: decoded by path through QFile
+ * as before the I/O stage existed, or fetched like the loaders do, copied into a buffer
+ * or memory-mapped. The bytes copied into user space and the page faults of each stage
+ * tell them apart; run with a cold page cache (e.g. after drop_caches) to compare disk reads.
+ *
+ * --verify instead compares the thumbnails of ImageDecoder::scaleCover with those of
+ * plain Qt scaling and fails if they differ by more than s_verifyTolerance on average.
+ * WALLPAPER_CAROUSEL_SIMD=scalar|sse4.1 checks the smaller kernels. It also decodes
+ * the first image stored as JPEG with each EXIF orientation through ImageDecoder::decodeCover,
+ * which crops and scales before the rotation is applied, against the rotated full decode.
+ */
+
+static constexpr double s_verifyTolerance      = 2.0;  // mean absolute difference per channel
+static constexpr double s_orientationTolerance = 6.0;  // decoded at reduced size, a wrong crop is far off
+static constexpr int s_verifyMaxImages         = 50;
+static constexpr int s_orientationFixtureSize  = 1200;  // px, longer side
+
+struct StageResult {
+    QString name;
+    qsizetype count    = 0;
+    double totalMs     = 0;
+    double p50Ms       = 0;
+    double p99Ms       = 0;
+    double perSecond   = 0;
+    qint64 copiedKb    = 0;  // file contents copied into user space, -1 if unknown
+    qint64 minorFaults = 0;
+    qint64 majorFaults = 0;  // needed a disk read
+};
+
+struct FaultCounts {
+    qint64 minor = 0;
+    qint64 major = 0;
+};
+
+static double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    const auto rank = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+    return samples[std::min(rank, samples.size() - 1)];
+}
+
+static StageResult makeResult(const QString& name, const std::vector<double>& samples, qsizetype count, double totalMs) {
+    StageResult result;
+    result.name      = name;
+    result.count     = count;
+    result.totalMs   = totalMs;
+    result.p50Ms     = percentile(samples, 0.50);
+    result.p99Ms     = percentile(samples, 0.99);
+    result.perSecond = totalMs > 0 ? count * 1000.0 / totalMs : 0;
+    return result;
+}
+
+static FaultCounts faultCounts() {
+    struct rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return {};
+    }
+    return {usage.ru_minflt, usage.ru_majflt};
+}
+
+static void addFaults(StageResult& result, const FaultCounts& before) {
+    const auto after   = faultCounts();
+    result.minorFaults = after.minor - before.minor;
+    result.majorFaults = after.major - before.major;
+}
+
+static qint64 peakRssKb() {
+    struct rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return usage.ru_maxrss;  // already KiB on Linux
+}
+
+// Fills dir with count images that compress roughly like photos, i.e. smooth with some detail
+static bool generateCorpus(const QString& dir, int count, const QSize& resolution, const QByteArray& format) {
+    std::atomic<int> failed{0};
+    QThreadPool pool;
+    for (int i = 0; i < count; i++) {
+        pool.start([=, &failed]() {
+            QRandomGenerator rng(static_cast<quint32>(i) + 1);
+            QImage image(resolution, QImage::Format_RGB32);
+            QPainter painter(&image);
+            QLinearGradient gradient(0, 0, resolution.width(), resolution.height());
+            gradient.setColorAt(0, QColor::fromHsv(rng.bounded(360), 160, 200));
+            gradient.setColorAt(1, QColor::fromHsv(rng.bounded(360), 200, 80));
+            painter.fillRect(image.rect(), gradient);
+            painter.setPen(Qt::NoPen);
+            for (int j = 0; j < 64; j++) {
+                painter.setBrush(QColor::fromHsv(rng.bounded(360), rng.bounded(256), rng.bounded(256), 96));
+                const int radius = rng.bounded(resolution.width() / 16 + 1, resolution.width() / 4 + 2);
+                painter.drawEllipse(QPoint(rng.bounded(resolution.width()), rng.bounded(resolution.height())),
+                                    radius,
+                                    radius);
+            }
+            painter.end();
+
+            const auto path = QString("%1/bench_%2.%3").arg(dir).arg(i, 6, 10, QChar('0')).arg(QString::fromLatin1(format));
+            if (!image.save(path, format.constData(), 90)) {
+                failed++;
+            }
+        });
+    }
+    pool.waitForDone();
+    return failed == 0;
+}
+
+// The thumbnail as made before ThumbnailScaler: scale everything, then crop
+static QImage scaleCoverQt(const QImage& image, const QSize& targetSize) {
+    const QImage scaled = image.scaled(targetSize, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
+    return scaled.copy((scaled.width() - targetSize.width()) / 2,
+                       (scaled.height() - targetSize.height()) / 2,
+                       targetSize.width(),
+                       targetSize.height());
+}
+
+// Mean absolute difference per channel of two images of the same size in a 4-byte format
+static double meanDifference(const QImage& actual, const QImage& expected, int& maxDiff) {
+    double sum = 0;
+    for (int y = 0; y < actual.height(); y++) {
+        const uchar* a = actual.constScanLine(y);
+        const uchar* e = expected.constScanLine(y);
+        for (int i = 0; i < actual.width() * 4; i++) {
+            const int diff = qAbs(a[i] - e[i]);
+            sum += diff;
+            maxDiff = qMax(maxDiff, diff);
+        }
+    }
+    return sum / (static_cast<qint64>(actual.width()) * actual.height() * 4);
+}
+
+static bool verifyOrientations(const QImage& image, const QSize& itemSize, QTextStream& out) {
+    const QImage fixture = image.width() > s_orientationFixtureSize || image.height() > s_orientationFixtureSize
+                               ? image.scaled(QSize(s_orientationFixtureSize, s_orientationFixtureSize),
+                                              Qt::KeepAspectRatio,
+                                              Qt::SmoothTransformation)
+                               : image;
+    bool passed = true;
+    // every combination of mirroring, flipping and rotating by 90 degrees
+    for (int i = 1; i < 8; i++) {
+        const auto transformation = static_cast<QImageIOHandler::Transformation>(i);
+        QByteArray data;
+        {
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::WriteOnly);
+            QImageWriter writer(&buffer, "jpeg");
+            if (!writer.supportsOption(QImageIOHandler::ImageTransformation)) {
+                out << "EXIF orientation not written by the JPEG plugin, orientations not verified\n";
+                return true;
+            }
+            writer.setQuality(95);
+            writer.setTransformation(transformation);
+            if (!writer.write(fixture)) {
+                out << QString("Failed to write orientation fixture: %1\n").arg(writer.errorString());
+                return false;
+            }
+        }
+
+        QImage full;
+        {
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::ReadOnly);
+            QImageReader reader(&buffer);
+            if (!reader.read(&full)) {
+                out << QString("Failed to read orientation fixture: %1\n").arg(reader.errorString());
+                return false;
+            }
+        }
+        const auto actual   = ImageDecoder::decodeCover(data, itemSize, "orientation fixture").convertToFormat(QImage::Format_RGB32);
+        const auto expected = scaleCoverQt(full, itemSize).convertToFormat(QImage::Format_RGB32);
+        if (actual.size() != expected.size()) {
+            out << QString("orientation=%1: size %2x%3, expected %4x%5\n")
+                       .arg(i)
+                       .arg(actual.width())
+                       .arg(actual.height())
+                       .arg(expected.width())
+                       .arg(expected.height());
+            passed = false;
+            continue;
+        }
+        int maxDiff       = 0;
+        const double mean = meanDifference(actual, expected, maxDiff);
+        const bool ok     = mean <= s_orientationTolerance;
+        out << QString("orientation=%1 mean_diff=%2 max_diff=%3 %4\n").arg(i).arg(mean).arg(maxDiff).arg(ok ? "PASS" : "FAIL");
+        passed = passed && ok;
+    }
+    return passed;
+}
+
+static int verifyScaler(const QStringList& paths, const QSize& itemSize, QTextStream& out) {
+    double sum       = 0;
+    qint64 channels  = 0;
+    int maxDiff      = 0;
+    double worstMean = 0;
+    int compared     = 0;
+    QImage fixture;
+    for (const auto& path : paths.mid(0, s_verifyMaxImages)) {
+        QImage image(path);
+        if (image.isNull()) {
+            continue;
+        }
+        if (fixture.isNull()) {
+            fixture = image;
+        }
+        const auto format   = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+        const auto actual   = ImageDecoder::scaleCover(image, itemSize).convertToFormat(format);
+        const auto expected = scaleCoverQt(image, itemSize).convertToFormat(format);
+        if (actual.size() != expected.size()) {
+            out << QString("%1: size %2x%3, expected %4x%5\n")
+                       .arg(path)
+                       .arg(actual.width())
+                       .arg(actual.height())
+                       .arg(expected.width())
+                       .arg(expected.height());
+            return 1;
+        }
+        const double imageMean     = meanDifference(actual, expected, maxDiff);
+        const qint64 imageChannels = static_cast<qint64>(actual.width()) * actual.height() * 4;
+        sum += imageMean * imageChannels;
+        channels += imageChannels;
+        worstMean = qMax(worstMean, imageMean);
+        compared++;
+    }
+    if (compared == 0) {
+        out << "No images to compare\n";
+        return 1;
+    }
+    const bool scaled = worstMean <= s_verifyTolerance;
+    out << QString("kernel=%1 images=%2 mean_diff=%3 worst_mean_diff=%4 max_diff=%5 %6\n")
+               .arg(ThumbnailScaler::kernelName())
+               .arg(compared)
+               .arg(sum / channels)
+               .arg(worstMean)
+               .arg(maxDiff)
+               .arg(scaled ? "PASS" : "FAIL");
+    const bool oriented = verifyOrientations(fixture.convertToFormat(QImage::Format_RGB32), itemSize, out);
+    return scaled && oriented ? 0 : 1;
+}
+
+// ImageData as made by the loaders from the contents fetched in mode, or by path if mode is empty
+static ImageData loadOne(const QString& path,
+                         const QSize& itemSize,
+                         Config::SortType sortType,
+                         const QString& mode,
+                         std::atomic<qint64>& copiedBytes) {
+    if (mode == "path") {
+        return ImageData(path, itemSize.width(), itemSize.height(), sortType);
+    }
+    FetchedImage fetched{path, itemSize, ThumbnailCache::makeKey(QFileInfo(path).absoluteFilePath(), itemSize), FileContents()};
+    // as the loaders do, the source is not needed if the thumbnail is cached
+    if (fetched.cacheKey.isValid() && !ThumbnailCache::instance()->contains(fetched.cacheKey)) {
+        const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            fetched.contents = FileContents::fetch(fd, fetched.cacheKey.size, mode == "mmap" ? FileContents::Map : FileContents::Read);
+            ::close(fd);
+            copiedBytes += fetched.contents.copiedBytes();
+        }
+    }
+    return ImageData(fetched, sortType);
+}
+
+// One pass of ImageData over all paths, returns per image latencies in ms
+static std::vector<double> loadAll(const QStringList& paths,
+                                   const QSize& itemSize,
+                                   Config::SortType sortType,
+                                   const QString& mode,
+                                   QThreadPool& pool,
+                                   const QElapsedTimer& clock,
+                                   std::atomic<qint64>& lastImageNs,
+                                   std::atomic<qint64>& copiedBytes,
+                                   std::atomic<int>& broken) {
+    std::vector<double> latencies(paths.size(), 0);
+    for (qsizetype i = 0; i < paths.size(); i++) {
+        pool.start([&, i]() {
+            QElapsedTimer timer;
+            timer.start();
+            const ImageData data = loadOne(paths[i], itemSize, sortType, mode, copiedBytes);
+            latencies[i]         = timer.nsecsElapsed() / 1e6;
+            if (data.image.isNull()) {
+                broken++;
+            }
+            // completions happen out of order, keep the latest
+            const qint64 now = clock.nsecsElapsed();
+            qint64 last      = lastImageNs.load();
+            while (now > last && !lastImageNs.compare_exchange_weak(last, now)) {
+            }
+        });
+    }
+    pool.waitForDone();
+    return latencies;
+}
+
+static QString formatCsv(const QList<StageResult>& stages, qint64 rssKb, double lastImageMs) {
+    QString out;
+    QTextStream stream(&out);
+    stream << "stage,count,total_ms,per_second,p50_ms,p99_ms,copied_kb,minor_faults,major_faults,"
+              "peak_rss_kb,time_to_last_image_ms\n";
+    for (const auto& stage : stages) {
+        stream << stage.name << ',' << stage.count << ',' << stage.totalMs << ',' << stage.perSecond << ','
+               << stage.p50Ms << ',' << stage.p99Ms << ',' << stage.copiedKb << ',' << stage.minorFaults << ','
+               << stage.majorFaults << ',' << rssKb << ',' << lastImageMs << '\n';
+    }
+    return out;
+}
+
+static QString formatJson(const QList<StageResult>& stages, qint64 rssKb, double lastImageMs, const QJsonObject& corpus) {
+    QJsonArray stageArray;
+    for (const auto& stage : stages) {
+        stageArray.append(QJsonObject{
+            {"name", stage.name},
+            {"count", stage.count},
+            {"total_ms", stage.totalMs},
+            {"per_second", stage.perSecond},
+            {"p50_ms", stage.p50Ms},
+            {"p99_ms", stage.p99Ms},
+            {"copied_kb", stage.copiedKb},
+            {"minor_faults", stage.minorFaults},
+            {"major_faults", stage.majorFaults},
+        });
+    }
+    const QJsonObject root{
+        {"corpus", corpus},
+        {"stages", stageArray},
+        {"peak_rss_kb", rssKb},
+        {"time_to_last_image_ms", lastImageMs},
+    };
+    return QString::fromUtf8(QJsonDocument(root).toJson(QJsonDocument::Indented));
+}
+
+int main(int argc, char* argv[]) {
+    // no display needed, but QPixmap and the image plugins still want a platform
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless benchmark of the wallpaper loading pipeline.");
+    parser.addHelpOption();
+    const QCommandLineOption countOption("count", "Number of images to generate.", "n", "200");
+    const QCommandLineOption resolutionOption("resolution", "Resolution of generated images.", "WxH", "3840x2160");
+    const QCommandLineOption formatOption("format", "Format of generated images.", "jpg|png|webp", "jpg");
+    const QCommandLineOption corpusOption("corpus", "Use the images in this directory instead of generating.", "dir");
+    const QCommandLineOption threadsOption("threads", "Decode threads, defaults to the ideal thread count.", "n");
+    const QCommandLineOption ioOption("io", "How the load stages get the file contents.", "path|read|mmap", "read");
+    const QCommandLineOption cacheOption("cache", "Enable the thumbnail cache and add a second, cached pass.");
+    const QCommandLineOption outputOption("output", "Result format.", "csv|json", "json");
+    const QCommandLineOption outOption("out", "Write results to this file instead of stdout.", "file");
+    const QCommandLineOption traceOption("trace", "Write a Chrome trace of the measured stages to this file.", "file");
+    const QCommandLineOption verifyOption("verify", "Compare the thumbnail scaler to Qt scaling instead of measuring.");
+    parser.addOptions({countOption,
+                       resolutionOption,
+                       formatOption,
+                       corpusOption,
+                       threadsOption,
+                       ioOption,
+                       cacheOption,
+                       outputOption,
+                       outOption,
+                       traceOption,
+                       verifyOption});
+    parser.process(a);
+
+#ifndef GENERAL_LOGGER_DISABLED
+    Logger::instance(stderr, GeneralLogger::LogIndent::GENERAL, &a);
+#endif  // GENERAL_LOGGER_DISABLED
+
+    QTextStream err(stderr);
+
+    // keep the user's caches and directory index out of the measurement
+    QTemporaryDir workDir;
+    if (!workDir.isValid()) {
+        err << "Failed to create a temporary directory\n";
+        return 1;
+    }
+    qputenv("XDG_CACHE_HOME", workDir.filePath("cache").toLocal8Bit());
+
+    const int count          = parser.value(countOption).toInt();
+    const auto resolutionArg = parser.value(resolutionOption).split('x');
+    const QSize resolution   = resolutionArg.size() == 2 ? QSize(resolutionArg[0].toInt(), resolutionArg[1].toInt()) : QSize();
+    const QByteArray format  = parser.value(formatOption).toLatin1();
+
+    QString corpusDir = parser.value(corpusOption);
+    if (corpusDir.isEmpty()) {
+        if (count <= 0 || resolution.isEmpty()) {
+            err << "Invalid --count or --resolution\n";
+            return 1;
+        }
+        corpusDir = workDir.filePath("corpus");
+        QDir().mkpath(corpusDir);
+        err << QString("Generating %1 %2x%3 %4 images ...\n")
+                   .arg(count)
+                   .arg(resolution.width())
+                   .arg(resolution.height())
+                   .arg(QString::fromLatin1(format));
+        err.flush();
+        if (!generateCorpus(corpusDir, count, resolution, format)) {
+            err << QString("Failed to generate the corpus, is the %1 image plugin available?\n").arg(QString::fromLatin1(format));
+            return 1;
+        }
+    }
+    corpusDir = QDir(corpusDir).absolutePath();
+
+    const QString ioMode = parser.value(ioOption);
+    if (ioMode != "path" && ioMode != "read" && ioMode != "mmap") {
+        err << "Invalid --io\n";
+        return 1;
+    }
+
+    const QString configDir = workDir.filePath("config");
+    QDir().mkpath(configDir);
+    {
+        QFile configFile(configDir + QDir::separator() + Config::s_DefaultConfigFileName);
+        if (!configFile.open(QIODevice::WriteOnly)) {
+            err << "Failed to write the benchmark config\n";
+            return 1;
+        }
+        const QJsonObject config{
+            {"wallpaper", QJsonObject{{"dirs", QJsonArray{corpusDir}}}},
+            {"cache", QJsonObject{{"enabled", parser.isSet(cacheOption)}}},
+        };
+        configFile.write(QJsonDocument(config).toJson());
+    }
+
+    if (parser.isSet(traceOption)) {
+        Trace::start(parser.value(traceOption));
+    }
+
+    QList<StageResult> stages;
+    QElapsedTimer clock;
+    clock.start();
+
+    // stage 1: scan
+    QElapsedTimer scanTimer;
+    scanTimer.start();
+    Config config(configDir);
+    const double scanMs = scanTimer.nsecsElapsed() / 1e6;
+    const auto& paths   = config.getWallpapers();
+    stages.append(makeResult("scan", {scanMs}, paths.size(), scanMs));
+
+    ThumbnailCache::instance()->setEnabled(config.getCacheConfig().enabled);
+
+    // stage 2: decode, scale and crop to the base item size, as the carousel does
+    const auto& style = config.getStyleConfig();
+    const QSize itemSize(style.imageWidth, static_cast<int>(style.imageWidth / style.aspectRatio));
+
+    if (parser.isSet(verifyOption)) {
+        QTextStream out(stdout);
+        return verifyScaler(paths, itemSize, out);
+    }
+
+    QThreadPool pool;
+    if (parser.isSet(threadsOption) && parser.value(threadsOption).toInt() > 0) {
+        pool.setMaxThreadCount(parser.value(threadsOption).toInt());
+    }
+
+    // QFile copies through its own buffers, which are not counted
+    const auto copiedKb = [&ioMode](qint64 bytes) { return ioMode == "path" ? -1 : bytes / 1024; };
+
+    std::atomic<qint64> lastImageNs{0};
+    std::atomic<qint64> copiedBytes{0};
+    std::atomic<int> broken{0};
+    QElapsedTimer loadTimer;
+    auto faults = faultCounts();
+    loadTimer.start();
+    auto latencies = loadAll(paths, itemSize, config.getSortConfig().type, ioMode, pool, clock, lastImageNs, copiedBytes, broken);
+    stages.append(makeResult("load", latencies, paths.size(), loadTimer.nsecsElapsed() / 1e6));
+    stages.last().copiedKb = copiedKb(copiedBytes);
+    addFaults(stages.last(), faults);
+    const double lastImageMs = lastImageNs / 1e6;
+
+    if (config.getCacheConfig().enabled) {
+        // the same corpus again, served from the thumbnails stored by the first pass
+        std::atomic<qint64> unused{0};
+        copiedBytes = 0;
+        faults      = faultCounts();
+        loadTimer.restart();
+        latencies = loadAll(paths, itemSize, config.getSortConfig().type, ioMode, pool, clock, unused, copiedBytes, broken);
+        stages.append(makeResult("load_cached", latencies, paths.size(), loadTimer.nsecsElapsed() / 1e6));
+        stages.last().copiedKb = copiedKb(copiedBytes);
+        addFaults(stages.last(), faults);
+    }
+
+    Trace::write();
+
+    if (broken > 0) {
+        err << QString("%1 images failed to load\n").arg(broken.load());
+    }
+
+    const QJsonObject corpus{
+        {"dir", corpusDir},
+        {"count", paths.size()},
+        {"generated", !parser.isSet(corpusOption)},
+        {"resolution", parser.isSet(corpusOption) ? QString() : parser.value(resolutionOption)},
+        {"format", parser.isSet(corpusOption) ? QString() : QString::fromLatin1(format)},
+        {"threads", pool.maxThreadCount()},
+        {"io", ioMode},
+        {"scaler", ThumbnailScaler::kernelName()},
+    };
+    const auto result = parser.value(outputOption) == "csv"
+                            ? formatCsv(stages, peakRssKb(), lastImageMs)
+                            : formatJson(stages, peakRssKb(), lastImageMs, corpus);
+
+    if (parser.isSet(outOption)) {
+        QFile outFile(parser.value(outOption));
+        if (!outFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << QString("Failed to open %1\n").arg(parser.value(outOption));
+            return 1;
+        }
+        outFile.write(result.toUtf8());
+    } else {
+        QTextStream(stdout) << result;
+    }
+    return 0;
+}
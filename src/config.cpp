@@ -1,11 +1,14 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-05 01:34:52
- * @LastEditTime: 2025-08-07 22:27:50
+ * @LastEditTime: 2026-10-25 15:08:27
  * @Description: Configuration manager.
  */
 #include "config.h"
 
+#include <string.h>
+#include <sys/stat.h>
+
 #include <QDir>
 #include <QFile>
 #include <QJsonArray>
@@ -14,7 +17,11 @@
 #include <QProcessEnvironment>
 #include <QStandardPaths>
 
+#include "directory_index.h"
 #include "logger.h"
+#include "rejected_image_cache.h"
+#include "trace.h"
+#include "wallpaper_scanner.h"
 using namespace GeneralLogger;
 
 static QString expandPath(const QString &path);
@@ -80,46 +87,76 @@ void Config::_loadConfig(const QString &configPath) {
             {"wallpaper.excludes", "excludes", [this](const QJsonValue &val) {
                  parseJsonArray(val, m_wallpaperConfig.excludes);
              }},
+            {"wallpaper.recursive", "recursive", [this](const QJsonValue &val) {
+                 if (val.isBool()) {
+                     m_wallpaperConfig.recursive = val.toBool();
+                     LOG_INFO(QString("Recursive: %1").arg(m_wallpaperConfig.recursive), GeneralLogger::STEP);
+                 }
+             }},
+            {"wallpaper.max_depth", "max_depth", [this](const QJsonValue &val) {
+                 if (val.isDouble() && val.toDouble() >= 0) {
+                     m_wallpaperConfig.maxDepth = val.toInt();
+                     LOG_INFO(QString("Max depth: %1").arg(m_wallpaperConfig.maxDepth), GeneralLogger::STEP);
+                 }
+             }},
+            {"wallpaper.watch", "watch", [this](const QJsonValue &val) {
+                 if (val.isBool()) {
+                     m_wallpaperConfig.watch = val.toBool();
+                     LOG_INFO(QString("Watch directories: %1").arg(m_wallpaperConfig.watch), GeneralLogger::STEP);
+                 }
+             }},
             {"action.confirm", "confirm", [this](const QJsonValue &val) {
                  if (val.isString()) {
                      m_actionConfig.confirm = ::expandPath(val.toString());
-                     info(QString("Action confirm: %1").arg(m_actionConfig.confirm), GeneralLogger::STEP);
+                     LOG_INFO(QString("Action confirm: %1").arg(m_actionConfig.confirm), GeneralLogger::STEP);
                  }
              }},
             {"style.aspect_ratio", "aspect_ratio", [this](const QJsonValue &val) {
                  if (val.isDouble() && val.toDouble() > 0) {
                      m_styleConfig.aspectRatio = val.toDouble();
-                     info(QString("Aspect ratio: %1").arg(m_styleConfig.aspectRatio), GeneralLogger::STEP);
+                     LOG_INFO(QString("Aspect ratio: %1").arg(m_styleConfig.aspectRatio), GeneralLogger::STEP);
                  }
              }},
             {"style.image_width", "image_width", [this](const QJsonValue &val) {
                  if (val.isDouble() && val.toDouble() > 0) {
                      m_styleConfig.imageWidth = val.toInt();
-                     info(QString("Image width: %1").arg(m_styleConfig.imageWidth), GeneralLogger::STEP);
+                     LOG_INFO(QString("Image width: %1").arg(m_styleConfig.imageWidth), GeneralLogger::STEP);
                  }
              }},
             {"style.image_focus_width", "image_focus_width", [this](const QJsonValue &val) {
                  if (val.isDouble() && val.toDouble() > 0) {
                      m_styleConfig.imageFocusWidth = val.toInt();
-                     info(QString("Image focus width: %1").arg(m_styleConfig.imageFocusWidth), GeneralLogger::STEP);
+                     LOG_INFO(QString("Image focus width: %1").arg(m_styleConfig.imageFocusWidth), GeneralLogger::STEP);
                  }
              }},
             {"style.window_width", "window_width", [this](const QJsonValue &val) {
                  if (val.isDouble() && val.toDouble() > 0) {
                      m_styleConfig.windowWidth = val.toInt();
-                     info(QString("Window width: %1").arg(m_styleConfig.windowWidth), GeneralLogger::STEP);
+                     LOG_INFO(QString("Window width: %1").arg(m_styleConfig.windowWidth), GeneralLogger::STEP);
                  }
              }},
             {"style.window_height", "window_height", [this](const QJsonValue &val) {
                  if (val.isDouble() && val.toDouble() > 0) {
                      m_styleConfig.windowHeight = val.toInt();
-                     info(QString("Window height: %1").arg(m_styleConfig.windowHeight), GeneralLogger::STEP);
+                     LOG_INFO(QString("Window height: %1").arg(m_styleConfig.windowHeight), GeneralLogger::STEP);
                  }
              }},
             {"style.no_loading_screen", "no_loading_screen", [this](const QJsonValue &val) {
                  if (val.isBool()) {
                      m_styleConfig.noLoadingScreen = val.toBool();
-                     info(QString("No loading screen: %1").arg(m_styleConfig.noLoadingScreen), GeneralLogger::STEP);
+                     LOG_INFO(QString("No loading screen: %1").arg(m_styleConfig.noLoadingScreen), GeneralLogger::STEP);
+                 }
+             }},
+            {"style.thumbnail_memory_mb", "thumbnail_memory_mb", [this](const QJsonValue &val) {
+                 if (val.isDouble() && val.toDouble() >= 0) {
+                     m_styleConfig.thumbnailMemoryMb = val.toInt();
+                     LOG_INFO(QString("Thumbnail memory budget: %1 MiB").arg(m_styleConfig.thumbnailMemoryMb), GeneralLogger::STEP);
+                 }
+             }},
+            {"style.prefetch_count", "prefetch_count", [this](const QJsonValue &val) {
+                 if (val.isDouble() && val.toDouble() >= 0) {
+                     m_styleConfig.prefetchCount = val.toInt();
+                     LOG_INFO(QString("Prefetch count: %1").arg(m_styleConfig.prefetchCount), GeneralLogger::STEP);
                  }
              }},
             {"sort.type", "type", [this](const QJsonValue &val) {
@@ -134,15 +171,45 @@ void Config::_loadConfig(const QString &configPath) {
                      } else if (type == "size") {
                          m_sortConfig.type = SortType::Size;
                      } else {
-                         warn(QString("Unknown sort type: %1").arg(type), GeneralLogger::STEP);
+                         LOG_WARN(QString("Unknown sort type: %1").arg(type), GeneralLogger::STEP);
                      }
                  }
-                 info(QString("Sort type: %1").arg(static_cast<int>(m_sortConfig.type)), GeneralLogger::STEP);
+                 LOG_INFO(QString("Sort type: %1").arg(static_cast<int>(m_sortConfig.type)), GeneralLogger::STEP);
              }},
             {"sort.reverse", "reverse", [this](const QJsonValue &val) {
                  if (val.isBool()) {
                      m_sortConfig.reverse = val.toBool();
-                     info(QString("Sort reverse: %1").arg(m_sortConfig.reverse), GeneralLogger::STEP);
+                     LOG_INFO(QString("Sort reverse: %1").arg(m_sortConfig.reverse), GeneralLogger::STEP);
+                 }
+             }},
+            {"cache.enabled", "enabled", [this](const QJsonValue &val) {
+                 if (val.isBool()) {
+                     m_cacheConfig.enabled = val.toBool();
+                     LOG_INFO(QString("Thumbnail cache enabled: %1").arg(m_cacheConfig.enabled), GeneralLogger::STEP);
+                 }
+             }},
+            {"cache.max_size_mb", "max_size_mb", [this](const QJsonValue &val) {
+                 if (val.isDouble() && val.toDouble() > 0) {
+                     m_cacheConfig.maxSizeMb = val.toInt();
+                     LOG_INFO(QString("Thumbnail cache max size: %1 MiB").arg(m_cacheConfig.maxSizeMb), GeneralLogger::STEP);
+                 }
+             }},
+            {"loading.io_threads", "io_threads", [this](const QJsonValue &val) {
+                 if (val.isDouble() && val.toDouble() > 0) {
+                     m_loadingConfig.ioThreads = val.toInt();
+                     LOG_INFO(QString("I/O threads: %1").arg(m_loadingConfig.ioThreads), GeneralLogger::STEP);
+                 }
+             }},
+            {"loading.decode_threads", "decode_threads", [this](const QJsonValue &val) {
+                 if (val.isDouble() && val.toDouble() >= 0) {
+                     m_loadingConfig.decodeThreads = val.toInt();
+                     LOG_INFO(QString("Decode threads: %1").arg(m_loadingConfig.decodeThreads), GeneralLogger::STEP);
+                 }
+             }},
+            {"loading.mmap", "mmap", [this](const QJsonValue &val) {
+                 if (val.isBool()) {
+                     m_loadingConfig.mmap = val.toBool();
+                     LOG_INFO(QString("Map source files: %1").arg(m_loadingConfig.mmap), GeneralLogger::STEP);
                  }
              }},
         };
@@ -169,52 +236,63 @@ void Config::_loadConfig(const QString &configPath) {
             if (currentObj.contains(finalKey)) {
                 mapping.parser(currentObj[finalKey]);
             } else {
-                warn(QString("Key '%1' not found in '%2'").arg(finalKey).arg(mapping.path));
+                LOG_WARN(QString("Key '%1' not found in '%2'").arg(finalKey).arg(mapping.path), GeneralLogger::DETAIL);
             }
         })();
     }
 }
 
 void Config::_loadWallpapers() {
+    TRACE_SPAN("scan");
     m_wallpapers.clear();
 
     QSet<QString> paths;
 
-    info(QString("Loading wallpapers from %1 specified paths").arg(m_wallpaperConfig.paths.size()), LogIndent::STEP);
+    LOG_INFO(QString("Loading wallpapers from %1 specified paths").arg(m_wallpaperConfig.paths.size()), GeneralLogger::STEP);
     for (const QString &path : m_wallpaperConfig.paths) {
         paths.insert(path);
     }
 
-    info(QString("Loading wallpapers from %1 specified directories").arg(m_wallpaperConfig.dirs.size()), LogIndent::STEP);
-    for (const QString &dirPath : m_wallpaperConfig.dirs) {
-        QDir dir(dirPath);
-        if (dir.exists()) {
-            QStringList files = dir.entryList(QDir::Files | QDir::NoDotAndDotDot);
-            for (const QString &file : files) {
-                QString filePath = dir.filePath(file);
-                paths.insert(filePath);
-            }
-        } else {
-            warn(QString("Directory '%1' does not exist").arg(dirPath));
+    LOG_INFO(QString("Loading wallpapers from %1 specified directories").arg(m_wallpaperConfig.dirs.size()), GeneralLogger::STEP);
+    // files found here are already known to be regular image files by their directory entries,
+    // unchanged directories are served from the index of the last run without being listed
+    DirectoryIndex index(DirectoryIndex::defaultFilePath());
+    index.load();
+    RejectedImageCache::instance()->load();
+    WallpaperScanner scanner(m_wallpaperConfig.recursive ? m_wallpaperConfig.maxDepth : 0, &index);
+    QSet<QString> scannedPaths;
+    for (const QString &filePath : scanner.scan(m_wallpaperConfig.dirs)) {
+        if (!paths.contains(filePath)) {
+            scannedPaths.insert(filePath);
         }
     }
-
-    info(QString("Excluding %1 specified paths").arg(m_wallpaperConfig.excludes.size()), LogIndent::STEP);
+    LOG_INFO(QString("Listed %1 directories, %2 served from index")
+                 .arg(scanner.getListedCount() + scanner.getIndexedCount())
+                 .arg(scanner.getIndexedCount()),
+             GeneralLogger::STEP);
+    index.save();
+    RejectedImageCache::instance()->save();
+
+    LOG_INFO(QString("Excluding %1 specified paths").arg(m_wallpaperConfig.excludes.size()), GeneralLogger::STEP);
     for (const QString &exclude : m_wallpaperConfig.excludes) {
         paths.remove(exclude);
+        scannedPaths.remove(exclude);
     }
 
-    m_wallpapers.reserve(paths.size());
+    m_wallpapers.reserve(paths.size() + scannedPaths.size());
     for (const QString &path : paths) {
         if (isValidImageFile(path)) {
             m_wallpapers.append(path);
         }
     }
+    for (const QString &path : scannedPaths) {
+        m_wallpapers.append(path);
+    }
 
-    info(QString("Found %1 wallpapers").arg(paths.size()));
+    info(QString("Found %1 wallpapers").arg(m_wallpapers.size()));
 }
 
-bool Config::isValidImageFile(const QString &filePath) {
+bool Config::hasValidExtension(const QString &filePath) {
     static const QStringList validExtensions = {
         ".jpg",
         ".jpeg",
@@ -228,25 +306,96 @@ bool Config::isValidImageFile(const QString &filePath) {
         ".heic",
         ".heif"};
 
+    for (const QString &ext : validExtensions) {
+        if (filePath.endsWith(ext, Qt::CaseInsensitive)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Config::isValidImageFile(const QString &filePath) {
+    TRACE_SPAN("is_valid_image", filePath);
     // check if exist
     if (!QFile::exists(filePath)) {
-        warn(QString("File does not exist: %1").arg(filePath));
+        LOG_WARN(QString("File does not exist: %1").arg(filePath), GeneralLogger::DETAIL);
         return false;
     }
     // check if normal file
     QFileInfo fileInfo(filePath);
     if (!(fileInfo.isFile() || fileInfo.isSymbolicLink()) || !fileInfo.isReadable()) {
-        warn(QString("Invalid file: %1").arg(filePath));
+        LOG_WARN(QString("Invalid file: %1").arg(filePath), GeneralLogger::DETAIL);
         return false;
     }
     // check if valid extension
-    for (const QString &ext : validExtensions) {
-        if (filePath.endsWith(ext, Qt::CaseInsensitive)) {
-            return true;
+    if (!hasValidExtension(filePath)) {
+        LOG_WARN(QString("Unsupported file type: %1").arg(filePath), GeneralLogger::DETAIL);
+        return false;
+    }
+    // check if the content is actually an image, unless already known not to be one
+    struct stat st{};
+    const qint64 mtimeNs = ::stat(QFile::encodeName(filePath).constData(), &st) == 0
+                               ? static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec
+                               : 0;
+    const auto rejected = RejectedImageCache::instance();
+    if (rejected->contains(filePath, mtimeNs)) {
+        return false;
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly) || sniffImageFormat(file.read(s_sniffSize)).isEmpty()) {
+        LOG_WARN(QString("Not a supported image: %1").arg(filePath), GeneralLogger::DETAIL);
+        rejected->insert(filePath, mtimeNs);
+        return false;
+    }
+    return true;
+}
+
+QByteArray Config::sniffImageFormat(const QByteArray &header) {
+    const auto startsWith = [&header](int offset, const char *magic, int length) {
+        return header.size() >= offset + length && memcmp(header.constData() + offset, magic, length) == 0;
+    };
+
+    if (startsWith(0, "\xFF\xD8\xFF", 3)) {
+        return "jpeg";
+    }
+    if (startsWith(0, "\x89PNG\r\n\x1A\n", 8)) {
+        return "png";
+    }
+    if (startsWith(0, "GIF87a", 6) || startsWith(0, "GIF89a", 6)) {
+        return "gif";
+    }
+    if (startsWith(0, "BM", 2)) {
+        return "bmp";
+    }
+    if (startsWith(0, "II*\0", 4) || startsWith(0, "MM\0*", 4)) {
+        return "tiff";
+    }
+    if (startsWith(0, "RIFF", 4) && startsWith(8, "WEBP", 4)) {
+        return "webp";
+    }
+    // ISO base media file, told apart by the major brand
+    if (startsWith(4, "ftyp", 4)) {
+        if (startsWith(8, "avif", 4) || startsWith(8, "avis", 4)) {
+            return "avif";
+        }
+        static const char *heifBrands[] = {"heic", "heix", "hevc", "hevx", "heim", "heis", "mif1", "msf1"};
+        for (const auto brand : heifBrands) {
+            if (startsWith(8, brand, 4)) {
+                return "heif";
+            }
         }
     }
-    warn(QString("Unsupported file type: %1").arg(filePath));
-    return false;
+    return {};
+}
+
+QString Config::cacheDir() {
+    auto baseDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+    if (baseDir.isEmpty()) {
+        baseDir = QDir::homePath() + QDir::separator() + ".cache";
+    }
+    const auto dir = baseDir + QDir::separator() + "wallpaper-carousel";
+    QDir().mkpath(dir);
+    return dir;
 }
 
 static QString expandPath(const QString &path) {
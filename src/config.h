@@ -1,7 +1,7 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-05 01:34:52
- * @LastEditTime: 2025-08-07 23:24:02
+ * @LastEditTime: 2026-10-26 14:40:13
  * @Description: Configuration manager.
  */
 #ifndef CONFIG_H
@@ -26,6 +26,9 @@ class Config : public QObject {
         QStringList paths;
         QStringList dirs;
         QStringList excludes;
+        bool recursive = false;
+        int maxDepth   = 8;     // only if recursive
+        bool watch     = true;  // apply changes in dirs while running
     };
 
     struct ActionConfigItems {
@@ -33,12 +36,14 @@ class Config : public QObject {
     };
 
     struct StyleConfigItems {
-        double aspectRatio   = 1.6;
-        int imageWidth       = 320;
-        int imageFocusWidth  = 480;
-        int windowWidth      = 750;
-        int windowHeight     = 500;
-        bool noLoadingScreen = false;
+        double aspectRatio    = 1.6;
+        int imageWidth        = 320;
+        int imageFocusWidth   = 480;
+        int windowWidth       = 750;
+        int windowHeight      = 500;
+        bool noLoadingScreen  = false;
+        int thumbnailMemoryMb = 256;  // 0 for unlimited
+        int prefetchCount     = 4;    // images kept at focus size ahead of the navigation
     };
 
     struct SortConfigItems {
@@ -46,12 +51,33 @@ class Config : public QObject {
         bool reverse  = false;
     };
 
+    struct CacheConfigItems {
+        bool enabled  = true;
+        int maxSizeMb = 512;
+    };
+
+    struct LoadingConfigItems {
+        int ioThreads     = 2;      // reading files ahead of decoding
+        int decodeThreads = 0;      // 0 for one per core
+        bool mmap         = false;  // map local files instead of reading them, unsafe if they are truncated meanwhile
+    };
+
     Config(const QString& configDir, const QStringList& searchDirs = {}, QObject* parent = nullptr);
 
     ~Config();
 
     static bool isValidImageFile(const QString& filePath);
 
+    static bool hasValidExtension(const QString& filePath);
+
+    // Container format by the leading bytes of a file, empty if not a supported image
+    static QByteArray sniffImageFormat(const QByteArray& header);
+
+    static constexpr int s_sniffSize = 16;
+
+    // $XDG_CACHE_HOME/wallpaper-carousel, created if missing
+    static QString cacheDir();
+
     [[nodiscard]] const QStringList& getWallpapers() const { return m_wallpapers; }
 
     [[nodiscard]] qint64 getWallpaperCount() const { return m_wallpapers.size(); }
@@ -64,6 +90,10 @@ class Config : public QObject {
 
     [[nodiscard]] const SortConfigItems& getSortConfig() const { return m_sortConfig; }
 
+    [[nodiscard]] const CacheConfigItems& getCacheConfig() const { return m_cacheConfig; }
+
+    [[nodiscard]] const LoadingConfigItems& getLoadingConfig() const { return m_loadingConfig; }
+
     static const QString s_DefaultConfigFileName;
     const QString m_configDir;
 
@@ -76,6 +106,8 @@ class Config : public QObject {
     ActionConfigItems m_actionConfig;
     StyleConfigItems m_styleConfig;
     SortConfigItems m_sortConfig;
+    CacheConfigItems m_cacheConfig;
+    LoadingConfigItems m_loadingConfig;
 
     QStringList m_wallpapers;
 };
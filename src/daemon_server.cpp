@@ -0,0 +1,128 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-21 09:26:44
+ * @LastEditTime: 2026-10-26 13:27:45
+ * @Description: Implementation of the daemon server.
+ */
+#include "daemon_server.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <QDir>
+#include <QFile>
+#include <QLocalSocket>
+#include <cstring>
+
+#include "logger.h"
+using namespace GeneralLogger;
+
+DaemonServer::DaemonServer(QObject* parent)
+    : QObject(parent), m_server(new QLocalServer(this)) {
+    // only the same user may talk to the daemon
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &DaemonServer::_onNewConnection);
+}
+
+DaemonServer::~DaemonServer() {
+    if (m_lockFd >= 0) {
+        // the lock file itself is left in place, removing it would race with the next daemon
+        ::close(m_lockFd);
+    }
+}
+
+QString DaemonServer::socketPath() {
+    const auto runtimeDir = qEnvironmentVariable("XDG_RUNTIME_DIR");
+    if (!runtimeDir.isEmpty()) {
+        return runtimeDir + QDir::separator() + "wallpaper-carousel.sock";
+    }
+    return QDir::tempPath() + QDir::separator() + QString("wallpaper-carousel-%1.sock").arg(::getuid());
+}
+
+bool DaemonServer::claim() {
+    if (m_lockFd >= 0) {
+        return true;
+    }
+    const auto lockPath = QFile::encodeName(socketPath() + ".lock");
+    const int fd        = ::open(lockPath.constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        error(QString("Failed to open %1").arg(QFile::decodeName(lockPath)));
+        return false;
+    }
+    // released by the kernel when the process exits, however that happens
+    if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        ::close(fd);
+        return false;
+    }
+    m_lockFd = fd;
+    return true;
+}
+
+bool DaemonServer::listen() {
+    if (m_lockFd < 0) {
+        error("Daemon lock is not held, not listening");
+        return false;
+    }
+    const auto path = socketPath();
+    // the lock says no other daemon is running, but make sure a leftover socket
+    // is actually dead before taking its place
+    if (sendCommand(s_pingCommand)) {
+        error(QString("Another daemon is listening on %1").arg(path));
+        return false;
+    }
+    QLocalServer::removeServer(path);
+    if (!m_server->listen(path)) {
+        error(QString("Failed to listen on %1: %2").arg(path, m_server->errorString()));
+        return false;
+    }
+    info(QString("Daemon listening on %1").arg(path));
+    return true;
+}
+
+bool DaemonServer::sendCommand(const QByteArray& command) {
+    const QByteArray path = QFile::encodeName(socketPath());
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (static_cast<size_t>(path.size()) >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.constData(), path.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    bool sent = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    if (sent) {
+        const QByteArray line = command + '\n';
+        sent                  = ::send(fd, line.constData(), line.size(), MSG_NOSIGNAL) == line.size();
+    }
+    ::close(fd);
+    return sent;
+}
+
+void DaemonServer::_onNewConnection() {
+    while (auto socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QLocalSocket::deleteLater);
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            _readCommands(socket);
+        });
+        // clients write right after connecting and may be gone already
+        _readCommands(socket);
+    }
+}
+
+void DaemonServer::_readCommands(QLocalSocket* socket) {
+    while (socket->canReadLine()) {
+        const auto command = socket->readLine().trimmed();
+        if (command == s_showCommand) {
+            info("Show requested by client");
+            emit showRequested();
+        } else if (command != s_pingCommand) {
+            warn(QString("Unknown daemon command: %1").arg(QString::fromUtf8(command)));
+        }
+    }
+}
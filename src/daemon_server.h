@@ -0,0 +1,65 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-21 09:26:44
+ * @LastEditTime: 2026-10-26 13:27:45
+ * @Description: Local socket server of the resident daemon mode.
+ */
+#ifndef DAEMON_SERVER_H
+#define DAEMON_SERVER_H
+
+#include <QByteArray>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QObject>
+#include <QString>
+
+/**
+ * @brief Accepts commands from later invocations while running with --daemon.
+ *        Each command is a single line, currently only "show" and "ping".
+ */
+class DaemonServer : public QObject {
+    Q_OBJECT
+
+  public:
+    explicit DaemonServer(QObject* parent = nullptr);
+
+    ~DaemonServer();
+
+    /**
+     * @brief Takes the lock file next to the socket, held until destruction,
+     *        so that only one daemon starts even while another one is still loading.
+     * @return false if another daemon holds it.
+     */
+    bool claim();
+
+    // Requires claim(). Call before loading, commands are handled once the event loop runs.
+    bool listen();
+
+    // $XDG_RUNTIME_DIR/wallpaper-carousel.sock, or a per-user socket in the temp dir
+    static QString socketPath();
+
+    /**
+     * @brief Sends a command to the running daemon, if any.
+     *        Plain POSIX, so that it can be used before QApplication is constructed.
+     * @return true if a daemon received the command.
+     */
+    static bool sendCommand(const QByteArray& command);
+
+    static constexpr const char* s_showCommand = "show";
+    static constexpr const char* s_pingCommand = "ping";
+
+  private slots:
+    void _onNewConnection();
+
+  private:
+    void _readCommands(QLocalSocket* socket);
+
+  private:
+    QLocalServer* m_server = nullptr;
+    int m_lockFd           = -1;
+
+  signals:
+    void showRequested();
+};
+
+#endif  // DAEMON_SERVER_H
@@ -0,0 +1,139 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-19 09:41:27
+ * @LastEditTime: 2026-10-27 14:21:48
+ * @Description: Implementation of the directory index.
+ */
+#include "directory_index.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+
+#include "config.h"
+#include "logger.h"
+using namespace GeneralLogger;
+
+DirectoryIndex::DirectoryIndex(const QString& filePath)
+    : m_filePath(filePath) {
+}
+
+QString DirectoryIndex::defaultFilePath() {
+    return Config::cacheDir() + QDir::separator() + "dir_index";
+}
+
+void DirectoryIndex::load() {
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;  // first run
+    }
+    QDataStream stream(&file);
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (magic != s_magic || version != s_version) {
+        warn(QString("Ignoring incompatible directory index: %1").arg(m_filePath));
+        return;
+    }
+
+    // counts come from the file, a corrupted one must not make us allocate more entries than it can hold
+    const auto fits = [&file, &stream](quint32 count, qint64 minEntrySize) {
+        if (stream.status() == QDataStream::Ok && count <= (file.size() - file.pos()) / minEntrySize) {
+            return true;
+        }
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return false;
+    };
+
+    QHash<QByteArray, DirEntry> dirs;
+    quint32 dirCount = 0;
+    stream >> dirCount;
+    for (quint32 i = 0; i < dirCount && stream.status() == QDataStream::Ok; i++) {
+        QByteArray path;
+        DirEntry dir;
+        quint32 fileCount = 0, subdirCount = 0;
+        stream >> path >> dir.mtimeNs >> fileCount;
+        if (!fits(fileCount, s_minFileEntrySize)) {
+            break;
+        }
+        dir.files.resize(fileCount);
+        for (auto& f : dir.files) {
+            stream >> f.name >> f.size >> f.mtimeNs;
+        }
+        stream >> subdirCount;
+        if (!fits(subdirCount, s_minSubdirEntrySize)) {
+            break;
+        }
+        dir.subdirs.resize(subdirCount);
+        for (auto& d : dir.subdirs) {
+            stream >> d;
+        }
+        dirs.insert(path, std::move(dir));
+    }
+    if (stream.status() != QDataStream::Ok) {
+        warn(QString("Ignoring corrupted directory index: %1").arg(m_filePath));
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_dirs.swap(dirs);
+    LOG_INFO(QString("Loaded index of %1 directories").arg(m_dirs.size()), GeneralLogger::STEP);
+}
+
+void DirectoryIndex::save() {
+    QMutexLocker locker(&m_mutex);
+    // drop directories which were not part of this scan
+    for (auto it = m_dirs.begin(); it != m_dirs.end();) {
+        if (m_touched.contains(it.key())) {
+            ++it;
+        } else {
+            it      = m_dirs.erase(it);
+            m_dirty = true;
+        }
+    }
+    if (!m_dirty) {
+        return;
+    }
+
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        warn(QString("Failed to write directory index: %1").arg(m_filePath));
+        return;
+    }
+    QDataStream stream(&file);
+    stream << s_magic << s_version << static_cast<quint32>(m_dirs.size());
+    for (auto it = m_dirs.cbegin(); it != m_dirs.cend(); ++it) {
+        const auto& dir = it.value();
+        stream << it.key() << dir.mtimeNs << static_cast<quint32>(dir.files.size());
+        for (const auto& f : dir.files) {
+            stream << f.name << f.size << f.mtimeNs;
+        }
+        stream << static_cast<quint32>(dir.subdirs.size());
+        for (const auto& d : dir.subdirs) {
+            stream << d;
+        }
+    }
+    if (!file.commit()) {
+        warn(QString("Failed to write directory index: %1").arg(m_filePath));
+        return;
+    }
+    m_dirty = false;
+}
+
+bool DirectoryIndex::lookup(const QByteArray& dirPath, qint64 mtimeNs, DirEntry& entry) {
+    QMutexLocker locker(&m_mutex);
+    m_touched.insert(dirPath);
+    const auto it = m_dirs.constFind(dirPath);
+    if (it == m_dirs.cend() || it->mtimeNs != mtimeNs) {
+        return false;
+    }
+    entry = *it;
+    return true;
+}
+
+void DirectoryIndex::update(const QByteArray& dirPath, const DirEntry& entry) {
+    QMutexLocker locker(&m_mutex);
+    m_touched.insert(dirPath);
+    m_dirs.insert(dirPath, entry);
+    m_dirty = true;
+}
@@ -0,0 +1,70 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-19 09:41:27
+ * @LastEditTime: 2026-10-27 14:21:48
+ * @Description: Persistent index of scanned wallpaper directories.
+ */
+#ifndef DIRECTORY_INDEX_H
+#define DIRECTORY_INDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief On-disk record of each scanned directory: its own mtime and the
+ *        filtered entries found in it. A directory whose mtime did not change
+ *        has the same entries and does not need to be listed again.
+ *        Paths are in the local 8-bit encoding. All methods are thread-safe.
+ */
+class DirectoryIndex {
+  public:
+    struct FileEntry {
+        QByteArray name;
+        qint64 size    = 0;
+        qint64 mtimeNs = 0;
+    };
+
+    struct DirEntry {
+        qint64 mtimeNs = 0;
+        QVector<FileEntry> files;
+        QVector<QByteArray> subdirs;  // including symlinks to directories
+    };
+
+    explicit DirectoryIndex(const QString& filePath);
+
+    DirectoryIndex(const DirectoryIndex&)            = delete;
+    DirectoryIndex& operator=(const DirectoryIndex&) = delete;
+
+    static QString defaultFilePath();
+
+    void load();
+
+    // Only writes if anything changed. Directories not looked up since load() are dropped.
+    void save();
+
+    // Returns false if the directory is unknown or has been modified since
+    bool lookup(const QByteArray& dirPath, qint64 mtimeNs, DirEntry& entry);
+
+    void update(const QByteArray& dirPath, const DirEntry& entry);
+
+  private:
+    static constexpr quint32 s_magic   = 0x57434449;  // "WCDI"
+    static constexpr quint32 s_version = 1;
+
+    // serialized sizes of the smallest entries, i.e. with empty names
+    static constexpr qint64 s_minFileEntrySize   = 4 + 8 + 8;  // name, size, mtime
+    static constexpr qint64 s_minSubdirEntrySize = 4;          // name
+
+    const QString m_filePath;
+
+    QMutex m_mutex;  // for everything below
+    QHash<QByteArray, DirEntry> m_dirs;
+    QSet<QByteArray> m_touched;
+    bool m_dirty = false;
+};
+
+#endif  // DIRECTORY_INDEX_H
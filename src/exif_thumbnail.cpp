@@ -0,0 +1,201 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-25 17:41:09
+ * @LastEditTime: 2026-10-25 17:41:09
+ * @Description: Implementation of the EXIF thumbnail lookup.
+ */
+#include "exif_thumbnail.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr quint16 s_tagOrientation     = 0x0112;
+constexpr quint16 s_tagCompression     = 0x0103;
+constexpr quint16 s_tagThumbnailOffset = 0x0201;  // JPEGInterchangeFormat
+constexpr quint16 s_tagThumbnailLength = 0x0202;  // JPEGInterchangeFormatLength
+constexpr quint32 s_compressionJpeg    = 6;
+
+/**
+ * TIFF structure inside the APP1 segment, offsets are relative to its header
+ * and every read is checked against its bounds.
+ */
+class TiffReader {
+  public:
+    TiffReader(const uchar* data, qsizetype size) : m_data(data), m_size(size) {}
+
+    bool init() {
+        if (m_size < 8) {
+            return false;
+        }
+        if (m_data[0] == 'I' && m_data[1] == 'I') {
+            m_littleEndian = true;
+        } else if (m_data[0] == 'M' && m_data[1] == 'M') {
+            m_littleEndian = false;
+        } else {
+            return false;
+        }
+        quint16 magic = 0;
+        return u16(2, magic) && magic == 42;
+    }
+
+    bool u16(qint64 offset, quint16& value) const {
+        if (offset < 0 || offset + 2 > m_size) {
+            return false;
+        }
+        const uchar* p = m_data + offset;
+        value          = m_littleEndian ? static_cast<quint16>(p[0] | p[1] << 8)
+                                        : static_cast<quint16>(p[0] << 8 | p[1]);
+        return true;
+    }
+
+    bool u32(qint64 offset, quint32& value) const {
+        if (offset < 0 || offset + 4 > m_size) {
+            return false;
+        }
+        const uchar* p = m_data + offset;
+        value          = m_littleEndian ? (quint32(p[0]) | quint32(p[1]) << 8 | quint32(p[2]) << 16 | quint32(p[3]) << 24)
+                                        : (quint32(p[0]) << 24 | quint32(p[1]) << 16 | quint32(p[2]) << 8 | quint32(p[3]));
+        return true;
+    }
+
+    // Value of a SHORT or LONG entry, stored within the entry itself
+    bool entryValue(qint64 entry, quint32& value) const {
+        quint16 type = 0;
+        if (!u16(entry + 2, type)) {
+            return false;
+        }
+        if (type == 3) {
+            quint16 shortValue = 0;
+            if (!u16(entry + 8, shortValue)) {
+                return false;
+            }
+            value = shortValue;
+            return true;
+        }
+        return type == 4 && u32(entry + 8, value);
+    }
+
+    [[nodiscard]] qsizetype size() const { return m_size; }
+
+  private:
+    const uchar* m_data;
+    qsizetype m_size;
+    bool m_littleEndian = true;
+};
+
+// Number of entries of the IFD at offset, -1 if it does not fit
+int ifdEntryCount(const TiffReader& tiff, qint64 offset) {
+    quint16 count = 0;
+    if (offset <= 0 || !tiff.u16(offset, count) || offset + 2 + count * 12 + 4 > tiff.size()) {
+        return -1;
+    }
+    return count;
+}
+
+// Where the embedded JPEG is within the TIFF structure, false if there is none
+bool findThumbnail(const TiffReader& tiff, quint32& offset, quint32& length, int& orientation) {
+    quint32 ifd0 = 0;
+    if (!tiff.u32(4, ifd0)) {
+        return false;
+    }
+    const int count0 = ifdEntryCount(tiff, ifd0);
+    if (count0 < 0) {
+        return false;
+    }
+    for (int i = 0; i < count0; i++) {
+        const qint64 entry = ifd0 + 2 + i * 12;
+        quint16 tag        = 0;
+        quint32 value      = 0;
+        if (tiff.u16(entry, tag) && tag == s_tagOrientation && tiff.entryValue(entry, value) && value >= 1 && value <= 8) {
+            orientation = static_cast<int>(value);
+        }
+    }
+
+    // the thumbnail is described by the next IFD
+    quint32 ifd1 = 0;
+    if (!tiff.u32(ifd0 + 2 + count0 * 12, ifd1) || ifd1 == ifd0) {
+        return false;
+    }
+    const int count1 = ifdEntryCount(tiff, ifd1);
+    if (count1 < 0) {
+        return false;
+    }
+    offset = 0;
+    length = 0;
+    for (int i = 0; i < count1; i++) {
+        const qint64 entry = ifd1 + 2 + i * 12;
+        quint16 tag        = 0;
+        quint32 value      = 0;
+        if (!tiff.u16(entry, tag) || !tiff.entryValue(entry, value)) {
+            continue;
+        }
+        if (tag == s_tagCompression && value != s_compressionJpeg) {
+            return false;  // uncompressed thumbnails are rare and not worth decoding by hand
+        } else if (tag == s_tagThumbnailOffset) {
+            offset = value;
+        } else if (tag == s_tagThumbnailLength) {
+            length = value;
+        }
+    }
+    return offset > 0 && length > 0 && static_cast<qint64>(offset) + length <= tiff.size();
+}
+
+}  // namespace
+
+QByteArray ExifThumbnail::extract(const QByteArray& data, int* orientation) {
+    if (orientation) {
+        *orientation = 1;
+    }
+    const auto bytes     = reinterpret_cast<const uchar*>(data.constData());
+    const qsizetype size = data.size();
+    if (size < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8) {
+        return {};
+    }
+
+    // metadata segments all come before the first scan
+    qsizetype pos = 2;
+    while (pos + 4 <= size) {
+        if (bytes[pos] != 0xFF) {
+            return {};
+        }
+        const uchar marker = bytes[pos + 1];
+        if (marker == 0xFF) {
+            pos++;  // fill byte
+            continue;
+        }
+        if (marker == 0xDA || marker == 0xD9) {
+            return {};  // start of scan or end of image
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            pos += 2;  // markers without a length
+            continue;
+        }
+        const qsizetype length = bytes[pos + 2] << 8 | bytes[pos + 3];
+        if (length < 2 || pos + 2 + length > size) {
+            return {};
+        }
+
+        const qsizetype payload = pos + 4;
+        if (marker == 0xE1 && length - 2 >= 6 && std::memcmp(bytes + payload, "Exif\0\0", 6) == 0) {
+            TiffReader tiff(bytes + payload + 6, length - 2 - 6);
+            quint32 offset        = 0;
+            quint32 thumbnailSize = 0;
+            int exifOrientation   = 1;
+            if (!tiff.init() || !findThumbnail(tiff, offset, thumbnailSize, exifOrientation)) {
+                return {};
+            }
+            if (orientation) {
+                *orientation = exifOrientation;
+            }
+            const qsizetype start = payload + 6 + offset;
+            if (thumbnailSize < 4 || bytes[start] != 0xFF || bytes[start + 1] != 0xD8) {
+                return {};
+            }
+            // a copy, data may be a mapping that is released before the thumbnail is decoded
+            return data.mid(start, thumbnailSize);
+        }
+        pos += 2 + length;
+    }
+    return {};
+}
@@ -0,0 +1,24 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-25 17:41:09
+ * @LastEditTime: 2026-10-25 17:41:09
+ * @Description: Locates the thumbnail embedded in the EXIF data of JPEG files.
+ */
+#ifndef EXIF_THUMBNAIL_H
+#define EXIF_THUMBNAIL_H
+
+#include <QByteArray>
+
+/**
+ * @brief Finds the JPEG preview that cameras and phones store in IFD1 of the
+ *        APP1 (EXIF) segment, by walking the segments before the image data only.
+ *        Can be safely used from any thread.
+ */
+class ExifThumbnail {
+  public:
+    // The embedded JPEG, empty if data is not a JPEG or carries no such thumbnail.
+    // orientation is set to the EXIF orientation of the image (1 to 8) if given, 1 if unknown.
+    static QByteArray extract(const QByteArray& data, int* orientation = nullptr);
+};
+
+#endif  // EXIF_THUMBNAIL_H
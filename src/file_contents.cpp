@@ -0,0 +1,109 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-25 15:08:27
+ * @LastEditTime: 2026-10-26 14:40:13
+ * @Description: Implementation of the file contents.
+ */
+#include "file_contents.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+// Whether fd is on a network or FUSE filesystem, where files are more likely to be changed
+// by others while mapped and a failed read turns into SIGBUS instead of an error
+static bool isRemoteFilesystem(int fd) {
+    struct statfs fs{};
+    if (::fstatfs(fd, &fs) != 0) {
+        return true;
+    }
+    switch (static_cast<quint32>(fs.f_type)) {
+        case 0x6969:      // NFS
+        case 0x517B:      // SMB
+        case 0xFF534D42:  // CIFS
+        case 0xFE534D42:  // SMB2
+        case 0x65735546:  // FUSE, e.g. sshfs
+        case 0x00C36400:  // Ceph
+        case 0x01021997:  // 9p
+        case 0x5346414F:  // AFS
+            return true;
+        default:
+            return false;
+    }
+}
+
+FileContents::Mapping::~Mapping() {
+    if (address) {
+        ::munmap(address, length);
+    }
+}
+
+FileContents FileContents::fetch(int fd, qint64 size, Mode mode) {
+    FileContents contents;
+    if (fd < 0 || size <= 0) {
+        return contents;
+    }
+
+    // changed since stat(), mapping past its end would fault on access
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<qint64>(st.st_size) != size) {
+        return contents;
+    }
+
+    // the mapping stays valid after fd is closed. Truncating the file while it is mapped
+    // raises SIGBUS on access, so mapping is opt-in and limited to local filesystems.
+    if (mode == Map && !isRemoteFilesystem(fd)) {
+        void* address = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            // decoders read front to back once, pages behind them can go early
+            ::madvise(address, static_cast<size_t>(size), MADV_SEQUENTIAL);
+            ::madvise(address, static_cast<size_t>(size), MADV_WILLNEED);
+            auto mapping       = std::make_shared<Mapping>();
+            mapping->address   = address;
+            mapping->length    = static_cast<size_t>(size);
+            contents.m_mapping = std::move(mapping);
+            return contents;
+        }
+        // e.g. files on a filesystem without mmap support
+    }
+
+    contents.m_buffer = QByteArray(static_cast<qsizetype>(size), Qt::Uninitialized);
+    qsizetype length  = 0;
+    while (length < contents.m_buffer.size()) {
+        const auto n = ::pread(fd,
+                               contents.m_buffer.data() + length,
+                               static_cast<size_t>(contents.m_buffer.size() - length),
+                               length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        length += n;
+    }
+    if (length != contents.m_buffer.size()) {
+        contents.m_buffer.clear();
+    }
+    return contents;
+}
+
+QByteArray FileContents::bytes() const {
+    if (m_mapping) {
+        return QByteArray::fromRawData(static_cast<const char*>(m_mapping->address),
+                                       static_cast<qsizetype>(m_mapping->length));
+    }
+    return m_buffer;
+}
+
+qint64 FileContents::size() const {
+    return m_mapping ? static_cast<qint64>(m_mapping->length) : m_buffer.size();
+}
+
+void FileContents::release() {
+    m_buffer.clear();
+    m_mapping.reset();
+}
@@ -0,0 +1,57 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-25 15:08:27
+ * @LastEditTime: 2026-10-26 14:40:13
+ * @Description: Contents of a source image, read into memory or memory-mapped.
+ */
+#ifndef FILE_CONTENTS_H
+#define FILE_CONTENTS_H
+
+#include <QByteArray>
+#include <memory>
+
+/**
+ * @brief Whole contents of a file, either copied into a buffer by read() or
+ *        mapped read-only without copying. Copies share the same contents,
+ *        the mapping is released together with the last of them.
+ *        A mapped file that is truncated meanwhile crashes the process with SIGBUS,
+ *        so Map falls back to Read on network and FUSE filesystems.
+ *        Can be safely passed between threads.
+ */
+class FileContents {
+  public:
+    enum Mode : qint32 {
+        Read = 0,
+        Map,
+    };
+
+    FileContents() = default;
+
+    // size as known from stat(); a null FileContents is returned if the file
+    // no longer has that size or could not be read completely
+    static FileContents fetch(int fd, qint64 size, Mode mode);
+
+    // Not owning the data for mappings, only valid as long as this is not released
+    [[nodiscard]] QByteArray bytes() const;
+
+    [[nodiscard]] bool isNull() const { return !m_mapping && m_buffer.isEmpty(); }
+
+    [[nodiscard]] qint64 size() const;
+
+    // Bytes copied into user space to get the contents, 0 for mappings
+    [[nodiscard]] qint64 copiedBytes() const { return m_buffer.size(); }
+
+    void release();
+
+  private:
+    struct Mapping {
+        void* address = nullptr;
+        size_t length = 0;
+        ~Mapping();
+    };
+
+    QByteArray m_buffer;
+    std::shared_ptr<const Mapping> m_mapping;
+};
+
+#endif  // FILE_CONTENTS_H
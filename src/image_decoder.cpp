@@ -0,0 +1,243 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-17 13:05:47
+ * @LastEditTime: 2026-10-27 10:03:55
+ * @Description: Implementation of the thumbnail decoder.
+ */
+#include "image_decoder.h"
+
+#include <QBuffer>
+#include <QFile>
+#include <QImageIOHandler>
+#include <QImageReader>
+#include <QTransform>
+
+#include "config.h"
+#include "exif_thumbnail.h"
+#include "logger.h"
+#include "thumbnail_scaler.h"
+#include "trace.h"
+using namespace GeneralLogger;
+
+QRect ImageDecoder::coverCropRect(const QSize& sourceSize, const QSize& targetSize) {
+    if (sourceSize.isEmpty() || targetSize.isEmpty()) {
+        return {};
+    }
+    // compare aspect ratios without floating point
+    const qint64 srcCross = static_cast<qint64>(sourceSize.width()) * targetSize.height();
+    const qint64 dstCross = static_cast<qint64>(targetSize.width()) * sourceSize.height();
+    QSize cropSize        = sourceSize;
+    if (srcCross > dstCross) {
+        // wider than target, crop left and right
+        cropSize.setWidth(qMax<qint64>(1, dstCross / targetSize.height()));
+    } else if (srcCross < dstCross) {
+        // taller than target, crop top and bottom
+        cropSize.setHeight(qMax<qint64>(1, srcCross / targetSize.width()));
+    }
+    return {(sourceSize.width() - cropSize.width()) / 2,
+            (sourceSize.height() - cropSize.height()) / 2,
+            cropSize.width(),
+            cropSize.height()};
+}
+
+QImage ImageDecoder::scaleCover(const QImage& image, const QSize& targetSize) {
+    if (image.isNull() || image.size() == targetSize) {
+        return image;
+    }
+    // resize in "cover" mode, filtering only the part that is kept
+    const QRect cropRect = coverCropRect(image.size(), targetSize);
+    {
+        TRACE_SPAN("scale");
+        QImage scaled = ThumbnailScaler::downscale(image, cropRect, targetSize);
+        if (!scaled.isNull()) {
+            return scaled;
+        }
+    }
+
+    // smaller than the target, left to Qt
+    TRACE_SPAN("scale_up");
+    return image.copy(cropRect).scaled(targetSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+// What the reader does to the decoded image, e.g. as told by the EXIF orientation.
+// Clip rects and scaled sizes apply to the image as stored, before that.
+static QImageIOHandler::Transformations appliedTransformation(QImageReader& reader) {
+    return reader.autoTransform() ? reader.transformation() : QImageIOHandler::TransformationNone;
+}
+
+// Transposed if rotated by 90 degrees, which works both ways
+static QSize transformedSize(const QSize& size, QImageIOHandler::Transformations transformation) {
+    return (transformation & QImageIOHandler::TransformationRotate90) ? size.transposed() : size;
+}
+
+// The rect of the stored image that ends up as rect of the displayed one.
+// The reader mirrors and flips first, then rotates clockwise, i.e. (x, y) -> (h - 1 - y, x).
+static QRect storedRect(const QRect& rect, const QSize& storedSize, QImageIOHandler::Transformations transformation) {
+    QRect stored = rect;
+    if (transformation & QImageIOHandler::TransformationRotate90) {
+        stored = QRect(rect.y(), storedSize.height() - rect.x() - rect.width(), rect.height(), rect.width());
+    }
+    if (transformation & QImageIOHandler::TransformationMirror) {
+        stored.moveLeft(storedSize.width() - stored.x() - stored.width());
+    }
+    if (transformation & QImageIOHandler::TransformationFlip) {
+        stored.moveTop(storedSize.height() - stored.y() - stored.height());
+    }
+    return stored;
+}
+
+// Null image if the reader cannot decode the covered region
+static QImage decodeCoverRegion(QImageReader& reader, const QSize& targetSize, const QString& path) {
+    // Probe the header and let the decoder produce only the covered region,
+    // at (or near) the target size if it can decode at reduced size.
+    // Otherwise the region is decoded as is and scaled by scaleCover
+    // rather than by the generic scaling of QImageReader.
+    // The crop is chosen on the image as displayed, e.g. portrait for rotated photos.
+    const auto transformation = appliedTransformation(reader);
+    const QSize storedSize    = reader.size();
+    if (!storedSize.isValid()) {
+        return {};
+    }
+    const QRect cropRect = ImageDecoder::coverCropRect(transformedSize(storedSize, transformation), targetSize);
+    reader.setClipRect(storedRect(cropRect, storedSize, transformation));
+    if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        reader.setScaledSize(transformedSize(targetSize, transformation));
+    }
+    QImage image;
+    bool decoded;
+    {
+        TRACE_SPAN("decode", path);
+        decoded = reader.read(&image);
+    }
+    if (!decoded) {
+        LOG_WARN(QString("Scaled decoding failed for %1: %2").arg(path, reader.errorString()), GeneralLogger::DETAIL);
+        return {};
+    }
+    return ImageDecoder::scaleCover(image, targetSize);
+}
+
+// Whether a decode which failed with error means that the file is not a valid image.
+// Only the formats that are actually installed can tell.
+static bool isContentError(QImageReader::ImageReaderError error, const QByteArray& header) {
+    const QByteArray format = Config::sniffImageFormat(header);
+    if (format.isEmpty()) {
+        return true;  // not (or no longer) an image at all
+    }
+    if (error == QImageReader::InvalidDataError) {
+        return true;
+    }
+    if (error == QImageReader::UnsupportedFormatError) {
+        const auto supported = QImageReader::supportedImageFormats();
+        return supported.contains(format) || (format == "heif" && supported.contains("heic"));
+    }
+    return false;
+}
+
+QImage ImageDecoder::decodeCover(const QString& path, const QSize& targetSize, bool* rejected) {
+    if (rejected) {
+        *rejected = false;
+    }
+    {
+        QImageReader reader(path);
+        const auto image = decodeCoverRegion(reader, targetSize, path);
+        if (!image.isNull()) {
+            return image;
+        }
+    }
+
+    // Fallback: full decode
+    QImage image;
+    {
+        TRACE_SPAN("decode_full", path);
+        QImageReader reader(path);
+        if (!reader.read(&image)) {
+            if (rejected && reader.error() != QImageReader::DeviceError) {
+                QFile file(path);
+                *rejected = file.open(QIODevice::ReadOnly) && isContentError(reader.error(), file.read(Config::s_sniffSize));
+            }
+            return {};
+        }
+    }
+    return scaleCover(image, targetSize);
+}
+
+QImage ImageDecoder::decodeCover(const QByteArray& data, const QSize& targetSize, const QString& path, bool* rejected) {
+    if (rejected) {
+        *rejected = false;
+    }
+    {
+        QBuffer buffer;
+        buffer.setData(data);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer);
+        const auto image = decodeCoverRegion(reader, targetSize, path);
+        if (!image.isNull()) {
+            return image;
+        }
+    }
+
+    // Fallback: full decode
+    QImage image;
+    {
+        TRACE_SPAN("decode_full", path);
+        QBuffer buffer;
+        buffer.setData(data);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer);
+        if (!reader.read(&image)) {
+            if (rejected) {
+                *rejected = isContentError(reader.error(), data.left(Config::s_sniffSize));
+            }
+            return {};
+        }
+    }
+    return scaleCover(image, targetSize);
+}
+
+QImage ImageDecoder::decodePreview(const QByteArray& data, const QSize& targetSize, const QString& path) {
+    TRACE_SPAN("decode_preview", path);
+    int orientation      = 1;
+    const auto thumbnail = ExifThumbnail::extract(data, &orientation);
+    QImage image;
+    if (thumbnail.isEmpty() || !image.loadFromData(thumbnail, "JPEG")) {
+        return {};
+    }
+
+    // the thumbnail is stored as captured, rotate it only if the image itself will be
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    if (QImageReader(&buffer).autoTransform() && orientation != 1) {
+        // EXIF orientations 2 to 8 as mirroring, flipping and rotating by 90 degrees, in that order
+        static constexpr bool s_mirror[]   = {false, true, true, false, false, false, true, true};
+        static constexpr bool s_flip[]     = {false, false, true, true, true, false, false, true};
+        static constexpr bool s_rotate90[] = {false, false, false, false, true, true, true, true};
+        const int i                        = orientation - 1;
+        if (s_mirror[i] || s_flip[i]) {
+            image = image.mirrored(s_mirror[i], s_flip[i]);
+        }
+        if (s_rotate90[i]) {
+            image = image.transformed(QTransform().rotate(90));
+        }
+    }
+    return scaleCover(image, targetSize);
+}
+
+QSize ImageDecoder::displayedSize(const QString& path) {
+    QImageReader reader(path);
+    return transformedSize(reader.size(), appliedTransformation(reader));
+}
+
+QImage ImageDecoder::decodeRegion(const QString& path, const QRect& sourceRect, const QSize& targetSize) {
+    QImageReader reader(path);
+    const auto transformation = appliedTransformation(reader);
+    reader.setClipRect(storedRect(sourceRect, reader.size(), transformation));
+    reader.setScaledSize(transformedSize(targetSize, transformation));
+    QImage image;
+    TRACE_SPAN("decode_region", path);
+    if (!reader.read(&image)) {
+        LOG_WARN(QString("Failed to decode region of %1: %2").arg(path, reader.errorString()), GeneralLogger::DETAIL);
+        return {};
+    }
+    return image;
+}
@@ -0,0 +1,50 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-17 13:05:47
+ * @LastEditTime: 2026-10-27 10:03:55
+ * @Description: Decodes images into cropped thumbnails.
+ */
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief Produces thumbnails in "cover" mode, i.e. scaled to fill the target size
+ *        and cropped to center. Can be safely used from any thread.
+ */
+class ImageDecoder {
+  public:
+    // Returns a null image on failure. rejected, if given, tells whether the failure means that
+    // the file is not a valid image, rather than e.g. an I/O error or a missing image format plugin.
+    static QImage decodeCover(const QString& path, const QSize& targetSize, bool* rejected = nullptr);
+
+    // Same, from the contents of the file at path already read into memory.
+    static QImage decodeCover(const QByteArray& data,
+                              const QSize& targetSize,
+                              const QString& path,
+                              bool* rejected = nullptr);
+
+    // Low resolution cover of the thumbnail embedded in the EXIF data of a JPEG,
+    // a null image if there is none.
+    static QImage decodePreview(const QByteArray& data, const QSize& targetSize, const QString& path);
+
+    // The centered region of the source that ends up in the thumbnail.
+    static QRect coverCropRect(const QSize& sourceSize, const QSize& targetSize);
+
+    // Scale and crop an already decoded image.
+    static QImage scaleCover(const QImage& image, const QSize& targetSize);
+
+    // Size of the image as displayed, i.e. after its EXIF orientation is applied, from the header only.
+    static QSize displayedSize(const QString& path);
+
+    // Decodes only sourceRect of the image, scaled to targetSize, both as displayed.
+    // Returns a null image on failure.
+    static QImage decodeRegion(const QString& path, const QRect& sourceRect, const QSize& targetSize);
+};
+
+#endif  // IMAGE_DECODER_H
@@ -0,0 +1,125 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-17 20:14:02
+ * @LastEditTime: 2026-10-27 11:36:42
+ * @Description: Implementation of the image load scheduler.
+ */
+#include "image_load_scheduler.h"
+
+#include <QThreadPool>
+#include <algorithm>
+#include <iterator>
+
+#include "logger.h"
+using namespace GeneralLogger;
+
+ImageLoadScheduler::ImageLoadScheduler(Config::SortType sortType, bool sortReverse)
+    : m_sortType(sortType), m_sortReverse(sortReverse) {
+    m_rankPool.setMaxThreadCount(1);
+}
+
+ImageLoadScheduler::~ImageLoadScheduler() {
+    // passes that have not started are of no use any more
+    m_rankPool.clear();
+    m_rankPool.waitForDone();
+}
+
+void ImageLoadScheduler::enqueue(const QStringList& paths) {
+    {
+        QMutexLocker locker(&m_mutex);
+        for (const auto& path : paths) {
+            const auto slot = m_slots.constFind(path);
+            if (slot != m_slots.constEnd()) {
+                // taken before, e.g. modified since: pending again at its known position,
+                // unless it still is
+                m_pending.emplace(slot.value(), path);
+            } else {
+                m_slots.insert(path, m_nextSlot);
+                m_pending.emplace(m_nextSlot, path);
+                m_nextSlot++;
+            }
+            if (m_sortType != Config::SortType::None) {
+                m_unranked.insert(path);
+            }
+        }
+    }
+    if (m_sortType == Config::SortType::None) {
+        // loading order is the display order, nothing to rank
+        return;
+    }
+    // in the background, the loaders keep taking paths in the provisional order meanwhile
+    m_rankPool.start([this]() { _rank(); });
+}
+
+bool ImageLoadScheduler::takeNext(QString& path) {
+    QMutexLocker locker(&m_mutex);
+    if (m_pending.empty()) {
+        return false;
+    }
+    // nearest pending slot on either side of the focus
+    auto it = m_pending.lower_bound({m_focusSlot, QString()});
+    if (it == m_pending.end()) {
+        --it;
+    } else if (it != m_pending.begin()) {
+        auto prev = std::prev(it);
+        if (m_focusSlot - prev->first < it->first - m_focusSlot) {
+            it = prev;
+        }
+    }
+    path = it->second;
+    m_pending.erase(it);
+    return true;
+}
+
+void ImageLoadScheduler::setFocus(const QString& path) {
+    QMutexLocker locker(&m_mutex);
+    m_focusPath = path;
+    m_focusSlot = m_slots.value(path, m_focusSlot);
+}
+
+void ImageLoadScheduler::_rank() {
+    QSet<QString> changed;
+    {
+        QMutexLocker locker(&m_mutex);
+        changed.swap(m_unranked);
+    }
+    if (changed.isEmpty()) {
+        return;  // already ranked by an earlier pass
+    }
+
+    // same keys as the carousel itself, so slots match the final positions.
+    // Only new and changed paths are stat'ed and collated, the others keep their keys.
+    std::vector<RankKey> keys;
+    keys.reserve(changed.size());
+    for (const auto& path : changed) {
+        keys.push_back({ImageSortKey::make(path, m_sortType), path});
+    }
+
+    const auto less = [this](const RankKey& a, const RankKey& b) {
+        const int cmp = ImageSortKey::compare(a.key, b.key, m_sortType);
+        return m_sortReverse ? cmp > 0 : cmp < 0;
+    };
+    std::stable_sort(keys.begin(), keys.end(), less);
+    m_ranked.erase(std::remove_if(m_ranked.begin(),
+                                  m_ranked.end(),
+                                  [&changed](const RankKey& ranked) { return changed.contains(ranked.path); }),
+                   m_ranked.end());
+    const auto middle = static_cast<std::ptrdiff_t>(m_ranked.size());
+    m_ranked.insert(m_ranked.end(), std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.end()));
+    std::inplace_merge(m_ranked.begin(), m_ranked.begin() + middle, m_ranked.end(), less);
+
+    QMutexLocker locker(&m_mutex);
+    for (qint64 i = 0; i < static_cast<qint64>(m_ranked.size()); i++) {
+        m_slots[m_ranked[i].path] = i;
+    }
+    // paths enqueued after the snapshot keep their provisional slots
+    // until the ranking pass scheduled by their own enqueue
+    std::set<std::pair<qint64, QString>> pending;
+    for (const auto& job : m_pending) {
+        pending.emplace(m_slots.value(job.second, job.first), job.second);
+    }
+    m_pending.swap(pending);
+    m_focusSlot = m_slots.value(m_focusPath, 0);
+    LOG_INFO(QString("Ranked %1 new or changed of %2 images for loading").arg(keys.size()).arg(m_ranked.size()),
+             GeneralLogger::DETAIL);
+}
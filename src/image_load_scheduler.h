@@ -0,0 +1,75 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-17 20:14:02
+ * @LastEditTime: 2026-10-27 11:36:42
+ * @Description: Orders pending image loads by distance from the focused image.
+ */
+#ifndef IMAGE_LOAD_SCHEDULER_H
+#define IMAGE_LOAD_SCHEDULER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+#include "image_sort_key.h"
+
+/**
+ * @brief Hands out pending image paths to ImageLoader workers, nearest to the
+ *        focused image first. Every path gets a slot which estimates its final
+ *        position in the carousel; until the slots are ranked in the background
+ *        they simply follow the order of enqueuing. Jobs far away from the focus
+ *        are demoted implicitly. All methods are thread-safe.
+ */
+class ImageLoadScheduler {
+  public:
+    ImageLoadScheduler(Config::SortType sortType, bool sortReverse);
+
+    ~ImageLoadScheduler();
+
+    ImageLoadScheduler(const ImageLoadScheduler&)            = delete;
+    ImageLoadScheduler& operator=(const ImageLoadScheduler&) = delete;
+
+    // Paths that have been taken before are pending again, paths still pending are not duplicated
+    void enqueue(const QStringList& paths);
+
+    // Returns false if nothing is pending
+    bool takeNext(QString& path);
+
+    // Reprioritize pending jobs around the slot of the given path
+    void setFocus(const QString& path);
+
+  private:
+    struct RankKey {
+        ImageSortKey key;
+        QString path;
+    };
+
+    void _rank();
+
+  private:
+    const Config::SortType m_sortType;
+    const bool m_sortReverse;
+
+    QMutex m_mutex;                                  // for everything below
+    std::set<std::pair<qint64, QString>> m_pending;  // (slot, path)
+    QHash<QString, qint64> m_slots;                  // slots of all known paths, pending or not
+    QSet<QString> m_unranked;                        // new or changed since the last ranking pass
+    QString m_focusPath;
+    qint64 m_nextSlot  = 0;
+    qint64 m_focusSlot = 0;
+
+    std::vector<RankKey> m_ranked;  // sorted keys of the ranked paths, ranking passes only
+
+    // Ranking passes run here one at a time. Declared last so that it is destroyed first,
+    // waiting for a running pass while everything it uses still exists.
+    QThreadPool m_rankPool;
+};
+
+#endif  // IMAGE_LOAD_SCHEDULER_H
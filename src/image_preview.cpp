@@ -0,0 +1,362 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-22 09:40:12
+ * @LastEditTime: 2026-10-27 10:03:55
+ * @Description: Implementation of the image preview.
+ */
+#include "image_preview.h"
+
+#include <QKeyEvent>
+#include <QMetaObject>
+#include <QMouseEvent>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QPointer>
+#include <QScreen>
+#include <QWheelEvent>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "image_decoder.h"
+#include "logger.h"
+using namespace GeneralLogger;
+
+ImagePreview::ImagePreview(QWidget* parent)
+    : QWidget(parent, Qt::Window) {
+    setWindowTitle("Wallpaper Carousel - Preview");
+    setFocusPolicy(Qt::StrongFocus);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    m_tiles.setMaxCost(s_tileCacheSize);
+}
+
+ImagePreview::~ImagePreview() {
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void ImagePreview::open(const QString& path, const QPixmap& placeholder) {
+    // forget everything about the previous image
+    m_generation++;
+    m_pool.clear();
+    m_inFlight.clear();
+    m_tiles.clear();
+    m_base = QImage();
+
+    m_path = path;
+    // header only, cheap enough for the GUI thread. Tiles are laid out on the image as displayed.
+    m_sourceSize = ImageDecoder::displayedSize(path);
+    if (!m_sourceSize.isValid()) {
+        warn(QString("Failed to read image size of %1").arg(path));
+    }
+    m_placeholder     = placeholder;
+    m_placeholderRect = ImageDecoder::coverCropRect(m_sourceSize, placeholder.size());
+    _fit();
+
+    // the whole image at screen resolution first, never upscaled
+    if (m_sourceSize.isValid()) {
+        const QSize screenSize = screen() ? screen()->size() : size();
+        QSize baseSize         = m_sourceSize;
+        if (baseSize.width() > screenSize.width() || baseSize.height() > screenSize.height()) {
+            baseSize = m_sourceSize.scaled(screenSize, Qt::KeepAspectRatio);
+        }
+        _decode(s_baseKey, QRect(QPoint(0, 0), m_sourceSize), baseSize);
+    }
+    update();
+}
+
+quint64 ImagePreview::_tileKey(int level, int x, int y) {
+    return (static_cast<quint64>(level) << 56) | (static_cast<quint64>(x) << 28) | static_cast<quint64>(y);
+}
+
+double ImagePreview::_fitScale() const {
+    if (m_sourceSize.isEmpty()) {
+        return 1.0;
+    }
+    return qMin(static_cast<double>(width()) / m_sourceSize.width(),
+                static_cast<double>(height()) / m_sourceSize.height());
+}
+
+QRectF ImagePreview::_visibleSourceRect() const {
+    const double w = width() / m_scale;
+    const double h = height() / m_scale;
+    return {m_center.x() - w / 2, m_center.y() - h / 2, w, h};
+}
+
+QRectF ImagePreview::_sourceToView(const QRectF& rect) const {
+    const auto visible = _visibleSourceRect();
+    return {(rect.x() - visible.x()) * m_scale,
+            (rect.y() - visible.y()) * m_scale,
+            rect.width() * m_scale,
+            rect.height() * m_scale};
+}
+
+int ImagePreview::_levelForScale(double scale) const {
+    // the coarsest level that still has at least one pixel per view pixel
+    if (scale >= 1.0) {
+        return 0;
+    }
+    return qBound(0, static_cast<int>(std::floor(std::log2(1.0 / scale))), 16);
+}
+
+QRect ImagePreview::_tileSourceRect(int level, int x, int y) const {
+    const int span = s_tileSize << level;
+    return QRect(x * span, y * span, span, span) & QRect(QPoint(0, 0), m_sourceSize);
+}
+
+void ImagePreview::_fit() {
+    m_fitted = true;
+    m_scale  = _fitScale();
+    m_center = QPointF(m_sourceSize.width() / 2.0, m_sourceSize.height() / 2.0);
+}
+
+void ImagePreview::_zoomAt(const QPointF& viewPos, double factor) {
+    if (m_sourceSize.isEmpty()) {
+        return;
+    }
+    // keep the source point under viewPos in place
+    const QPointF anchor = _visibleSourceRect().topLeft() + viewPos / m_scale;
+    const double fit     = _fitScale();
+    m_scale              = qBound(fit, m_scale * factor, qMax(fit, s_maxZoom));
+    m_center             = anchor - (viewPos - QPointF(width() / 2.0, height() / 2.0)) / m_scale;
+    m_fitted             = m_scale <= fit;
+    _clampCenter();
+    _requestTiles();
+    update();
+}
+
+void ImagePreview::_pan(const QPointF& viewDelta) {
+    m_center -= viewDelta / m_scale;
+    _clampCenter();
+    _requestTiles();
+    update();
+}
+
+void ImagePreview::_clampCenter() {
+    const auto visible = _visibleSourceRect();
+    const auto clamp   = [](double center, double view, double source) {
+        // centered if it fits, otherwise never showing anything beyond the edges
+        if (view >= source) {
+            return source / 2;
+        }
+        return qBound(view / 2, center, source - view / 2);
+    };
+    m_center = QPointF(clamp(m_center.x(), visible.width(), m_sourceSize.width()),
+                       clamp(m_center.y(), visible.height(), m_sourceSize.height()));
+}
+
+void ImagePreview::_requestTiles() {
+    if (m_sourceSize.isEmpty()) {
+        return;
+    }
+    QSet<quint64> wanted;
+    std::vector<std::pair<quint64, QRect>> requests;
+    int level = 0;
+    // the base image is enough as long as it is not magnified
+    const double baseScale = m_base.isNull() ? 0.0 : static_cast<double>(m_base.width()) / m_sourceSize.width();
+    if (m_scale > baseScale) {
+        level               = _levelForScale(m_scale);
+        const int span      = s_tileSize << level;
+        const QRect visible = _visibleSourceRect().toAlignedRect() & QRect(QPoint(0, 0), m_sourceSize);
+        for (int y = visible.top() / span; y <= visible.bottom() / span; y++) {
+            for (int x = visible.left() / span; x <= visible.right() / span; x++) {
+                const quint64 key = _tileKey(level, x, y);
+                if (m_tiles.contains(key)) {
+                    continue;
+                }
+                wanted.insert(key);
+                // a tile of a previous view may still be decoding, it is not queued twice
+                if (!m_inFlight.contains(key)) {
+                    requests.emplace_back(key, _tileSourceRect(level, x, y));
+                }
+            }
+        }
+    }
+
+    // tiles of previous views which have not started yet are skipped by their jobs
+    {
+        QMutexLocker locker(&m_wantedMutex);
+        m_wanted = std::move(wanted);
+    }
+    const int factor = 1 << level;
+    for (const auto& [key, sourceRect] : requests) {
+        _decode(key,
+                sourceRect,
+                QSize((sourceRect.width() + factor - 1) / factor, (sourceRect.height() + factor - 1) / factor));
+    }
+}
+
+void ImagePreview::_decode(quint64 key, const QRect& sourceRect, const QSize& size) {
+    const QString path       = m_path;
+    const quint64 generation = m_generation;
+    QPointer<ImagePreview> self(this);
+    m_inFlight.insert(key);
+    m_pool.start([self, path, generation, key, sourceRect, size]() {
+        if (!self) {
+            return;
+        }
+        // the destructor waits for the pool, so self stays valid while the job runs
+        bool skipped = false;
+        if (key != s_baseKey) {
+            QMutexLocker locker(&self->m_wantedMutex);
+            skipped = !self->m_wanted.contains(key);
+        }
+        const QImage image = skipped ? QImage() : ImageDecoder::decodeRegion(path, sourceRect, size);
+        QMetaObject::invokeMethod(
+            self.data(),
+            [self, generation, key, image, skipped]() {
+                self->_onDecoded(generation, key, image, skipped);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+void ImagePreview::_onDecoded(quint64 generation, quint64 key, const QImage& image, bool skipped) {
+    if (generation != m_generation) {
+        return;
+    }
+    m_inFlight.remove(key);
+    if (skipped) {
+        // the view may have come back to the tile after its job started
+        bool wanted;
+        {
+            QMutexLocker locker(&m_wantedMutex);
+            wanted = m_wanted.contains(key);
+        }
+        if (wanted) {
+            _requestTiles();
+        }
+        return;
+    }
+    if (image.isNull()) {
+        return;
+    }
+    if (key == s_baseKey) {
+        m_base = image;
+        // the view may have been zoomed in before the base image arrived
+        _requestTiles();
+    } else {
+        m_tiles.insert(key, new QImage(image), qMax<qint64>(1, image.sizeInBytes() / 1024));
+    }
+    update();
+}
+
+void ImagePreview::_close() {
+    hide();
+    m_generation++;
+    m_pool.clear();
+    m_inFlight.clear();
+    emit closed();
+}
+
+void ImagePreview::paintEvent(QPaintEvent* event) {
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    if (m_sourceSize.isEmpty()) {
+        return;
+    }
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+
+    // coarse to fine, whatever is not decoded yet shows the coarser data below it
+    if (!m_base.isNull()) {
+        painter.drawImage(_sourceToView(QRectF(QPointF(0, 0), m_sourceSize)), m_base);
+    } else if (!m_placeholder.isNull()) {
+        painter.drawPixmap(_sourceToView(m_placeholderRect), m_placeholder, m_placeholder.rect());
+    }
+    const double baseScale = m_base.isNull() ? 0.0 : static_cast<double>(m_base.width()) / m_sourceSize.width();
+    if (m_scale <= baseScale) {
+        return;
+    }
+    const int finest    = _levelForScale(m_scale);
+    const QRect visible = _visibleSourceRect().toAlignedRect() & QRect(QPoint(0, 0), m_sourceSize);
+    for (int level = finest + 2; level >= finest; level--) {
+        const int span = s_tileSize << level;
+        for (int y = visible.top() / span; y <= visible.bottom() / span; y++) {
+            for (int x = visible.left() / span; x <= visible.right() / span; x++) {
+                if (const auto tile = m_tiles.object(_tileKey(level, x, y))) {
+                    painter.drawImage(_sourceToView(_tileSourceRect(level, x, y)), *tile);
+                }
+            }
+        }
+    }
+}
+
+void ImagePreview::wheelEvent(QWheelEvent* event) {
+    const int delta = event->angleDelta().y();
+    if (delta == 0) {
+        QWidget::wheelEvent(event);
+        return;
+    }
+    _zoomAt(event->position(), delta > 0 ? s_zoomStep : 1.0 / s_zoomStep);
+}
+
+void ImagePreview::mousePressEvent(QMouseEvent* event) {
+    if (event->button() == Qt::LeftButton) {
+        m_dragging = true;
+        m_dragPos  = event->pos();
+    } else if (event->button() == Qt::RightButton) {
+        _close();
+    }
+}
+
+void ImagePreview::mouseMoveEvent(QMouseEvent* event) {
+    if (!m_dragging) {
+        return;
+    }
+    _pan(event->pos() - m_dragPos);
+    m_dragPos = event->pos();
+}
+
+void ImagePreview::mouseReleaseEvent(QMouseEvent* event) {
+    if (event->button() == Qt::LeftButton) {
+        m_dragging = false;
+    }
+}
+
+void ImagePreview::keyPressEvent(QKeyEvent* event) {
+    const QPointF center(width() / 2.0, height() / 2.0);
+    const double step = qMin(width(), height()) / 10.0;
+    switch (event->key()) {
+        case Qt::Key_Escape:
+        case Qt::Key_Z:
+        case Qt::Key_Q:
+            _close();
+            break;
+        case Qt::Key_Plus:
+        case Qt::Key_Equal:
+            _zoomAt(center, s_zoomStep);
+            break;
+        case Qt::Key_Minus:
+            _zoomAt(center, 1.0 / s_zoomStep);
+            break;
+        case Qt::Key_0:
+            _fit();
+            update();
+            break;
+        case Qt::Key_Left:
+            _pan(QPointF(step, 0));
+            break;
+        case Qt::Key_Right:
+            _pan(QPointF(-step, 0));
+            break;
+        case Qt::Key_Up:
+            _pan(QPointF(0, step));
+            break;
+        case Qt::Key_Down:
+            _pan(QPointF(0, -step));
+            break;
+        default:
+            QWidget::keyPressEvent(event);
+    }
+}
+
+void ImagePreview::resizeEvent(QResizeEvent* event) {
+    QWidget::resizeEvent(event);
+    if (m_fitted) {
+        _fit();
+    } else {
+        _clampCenter();
+    }
+    _requestTiles();
+}
@@ -0,0 +1,98 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-22 09:40:12
+ * @LastEditTime: 2026-10-26 17:20:44
+ * @Description: Full-screen preview with tiled decoding.
+ */
+#ifndef IMAGE_PREVIEW_H
+#define IMAGE_PREVIEW_H
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QPixmap>
+#include <QPointF>
+#include <QRectF>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <QWidget>
+
+/**
+ * @brief Full-screen zoomable preview of a single image. The whole image is
+ *        first decoded at screen resolution, zooming in beyond that decodes
+ *        only the visible tiles at the resolution needed, on worker threads.
+ *        Levels of detail are powers of two, level 0 being the full resolution.
+ */
+class ImagePreview : public QWidget {
+    Q_OBJECT
+
+  public:
+    explicit ImagePreview(QWidget* parent = nullptr);
+    ~ImagePreview();
+
+    // The placeholder, i.e. the cover-cropped thumbnail, is shown over the
+    // region it was cropped from until the first decode finishes.
+    void open(const QString& path, const QPixmap& placeholder);
+
+    static constexpr int s_tileSize      = 512;         // px at the level of the tile
+    static constexpr int s_tileCacheSize = 256 * 1024;  // KiB
+    static constexpr double s_maxZoom    = 4.0;         // view px per source px
+    static constexpr double s_zoomStep   = 1.25;
+
+  protected:
+    void paintEvent(QPaintEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+
+  private:
+    static quint64 _tileKey(int level, int x, int y);
+
+    [[nodiscard]] double _fitScale() const;
+    [[nodiscard]] QRectF _visibleSourceRect() const;
+    [[nodiscard]] QRectF _sourceToView(const QRectF& rect) const;
+    [[nodiscard]] int _levelForScale(double scale) const;
+    [[nodiscard]] QRect _tileSourceRect(int level, int x, int y) const;
+
+    void _fit();
+    void _zoomAt(const QPointF& viewPos, double factor);
+    void _pan(const QPointF& viewDelta);
+    void _clampCenter();
+    void _requestTiles();
+    void _decode(quint64 key, const QRect& sourceRect, const QSize& size);
+    void _onDecoded(quint64 generation, quint64 key, const QImage& image, bool skipped);
+    void _close();
+
+  private:
+    static constexpr quint64 s_baseKey = ~0ull;
+
+    QString m_path;
+    QSize m_sourceSize;
+    quint64 m_generation = 0;  // results of previously opened images are dropped
+
+    QPixmap m_placeholder;
+    QRect m_placeholderRect;  // in source coordinates
+    QImage m_base;            // whole image at screen resolution
+
+    double m_scale = 1.0;  // view px per source px
+    QPointF m_center;      // source coordinates at the center of the view
+    bool m_fitted = true;  // follows the size of the view
+
+    QCache<quint64, QImage> m_tiles;  // cost in KiB
+    QSet<quint64> m_inFlight;         // queued or being decoded, until _onDecoded
+    QMutex m_wantedMutex;
+    QSet<quint64> m_wanted;  // tiles of the current view, others are skipped when their job starts
+    QThreadPool m_pool;
+
+    bool m_dragging = false;
+    QPoint m_dragPos;
+
+  signals:
+    void closed();
+};
+
+#endif  // IMAGE_PREVIEW_H
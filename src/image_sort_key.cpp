@@ -0,0 +1,43 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-18 11:20:36
+ * @LastEditTime: 2026-10-18 13:47:58
+ * @Description: Implementation of image sort keys.
+ */
+#include "image_sort_key.h"
+
+#include <sys/stat.h>
+
+#include <QCollator>
+#include <QFile>
+#include <QFileInfo>
+
+// QCollator is not meant to be shared between threads
+static const QCollator& threadCollator() {
+    thread_local const QCollator collator;
+    return collator;
+}
+
+ImageSortKey ImageSortKey::make(const QString& path, Config::SortType sortType) {
+    if (sortType != Config::SortType::Date && sortType != Config::SortType::Size) {
+        return make(path, sortType, 0, 0);
+    }
+    struct stat st{};
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return make(path, sortType, 0, 0);
+    }
+    return make(path,
+                sortType,
+                static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec,
+                static_cast<qint64>(st.st_size));
+}
+
+ImageSortKey ImageSortKey::make(const QString& path, Config::SortType sortType, qint64 mtime, qint64 size) {
+    ImageSortKey key;
+    key.mtime = mtime;
+    key.size  = size;
+    if (sortType == Config::SortType::Name) {
+        key.name = threadCollator().sortKey(QFileInfo(path).fileName());
+    }
+    return key;
+}
@@ -0,0 +1,50 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-18 11:20:36
+ * @LastEditTime: 2026-10-18 13:47:58
+ * @Description: Compact precomputed sort keys of images.
+ */
+#ifndef IMAGE_SORT_KEY_H
+#define IMAGE_SORT_KEY_H
+
+#include <QCollatorSortKey>
+#include <QString>
+#include <optional>
+
+#include "config.h"
+
+/**
+ * @brief Sort key of an image, computed once off the main thread
+ *        so that comparing two images never touches the file system
+ *        or allocates. Only the parts relevant to the sort type are filled.
+ */
+struct ImageSortKey {
+    qint64 mtime = 0;  // nanoseconds since epoch
+    qint64 size  = 0;
+    std::optional<QCollatorSortKey> name;
+
+    // Stats the file if needed.
+    static ImageSortKey make(const QString& path, Config::SortType sortType);
+
+    // For callers which already have the file stat'ed.
+    static ImageSortKey make(const QString& path, Config::SortType sortType, qint64 mtime, qint64 size);
+
+    // Three-way comparison, negative if a is ordered before b.
+    static int compare(const ImageSortKey& a, const ImageSortKey& b, Config::SortType sortType) {
+        switch (sortType) {
+            case Config::SortType::Name:
+                if (a.name && b.name) {
+                    return a.name->compare(*b.name);
+                }
+                return static_cast<int>(a.name.has_value()) - static_cast<int>(b.name.has_value());
+            case Config::SortType::Date:
+                return (a.mtime > b.mtime) - (a.mtime < b.mtime);
+            case Config::SortType::Size:
+                return (a.size > b.size) - (a.size < b.size);
+            default:
+                return 0;
+        }
+    }
+};
+
+#endif  // IMAGE_SORT_KEY_H
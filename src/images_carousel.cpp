@@ -1,28 +1,38 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-05 01:22:53
- * @LastEditTime: 2025-08-11 19:44:06
+ * @LastEditTime: 2026-10-27 13:05:19
  * @Description: Animated carousel widget for displaying and selecting images.
  */
 #include "images_carousel.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <unistd.h>
 
-#include <QLabel>
+#include <QElapsedTimer>
 #include <QMetaObject>
-#include <QScrollArea>
+#include <QMouseEvent>
+#include <QPaintEvent>
 #include <QScrollBar>
+#include <QThread>
 #include <QVector>
-#include <functional>
+#include <algorithm>
+#include <cmath>
 
+#include "image_decoder.h"
 #include "logger.h"
+#include "rejected_image_cache.h"
+#include "thumbnail_cache.h"
+#include "trace.h"
 #include "ui_images_carousel.h"
 
 using namespace GeneralLogger;
 
 ImagesCarousel::ImagesCarousel(const Config::StyleConfigItems& styleConfig,
                                const Config::SortConfigItems& sortConfig,
+                               const Config::LoadingConfigItems& loadingConfig,
                                QWidget* parent)
     : QWidget(parent),
       ui(new Ui::ImagesCarousel),
@@ -31,20 +41,42 @@ ImagesCarousel::ImagesCarousel(const Config::StyleConfigItems& styleConfig,
       m_itemFocusWidth(styleConfig.imageFocusWidth),
       m_itemFocusHeight(static_cast<int>(styleConfig.imageFocusWidth / styleConfig.aspectRatio)),
       m_sortType(sortConfig.type),
-      m_sortReverse(sortConfig.reverse) {
+      m_sortReverse(sortConfig.reverse),
+      m_loadScheduler(sortConfig.type, sortConfig.reverse),
+      m_prefetchCount(styleConfig.prefetchCount) {
     ui->setupUi(this);
+    m_memoryBudget = static_cast<qint64>(styleConfig.thumbnailMemoryMb) * 1024 * 1024;
     m_scrollArea   = dynamic_cast<ImagesCarouselScrollArea*>(ui->scrollArea);
-    m_imagesLayout = dynamic_cast<QHBoxLayout*>(ui->scrollAreaWidgetContents->layout());
+    m_scrollArea->setCarousel(this);
+
+    // mostly waiting for disks, a few threads are enough to keep them busy;
+    // decoding is bound by the cores
+    m_ioPool.setMaxThreadCount(qMax(1, loadingConfig.ioThreads));
+    m_decodePool.setMaxThreadCount(loadingConfig.decodeThreads > 0 ? loadingConfig.decodeThreads
+                                                                     : QThread::idealThreadCount());
+    m_fetchMode = loadingConfig.mmap ? FileContents::Map : FileContents::Read;
 
     // Remove border
     ui->scrollArea->setFrameShape(QFrame::NoFrame);
 
+    connect(m_scrollArea,
+            &ImagesCarouselScrollArea::itemClicked,
+            this,
+            &ImagesCarousel::_onItemClicked);
+
     // Load initial images
     connect(this,
             &ImagesCarousel::loadingCompleted,
             this,
             &ImagesCarousel::_onInitImagesLoaded);
 
+    // Animations
+    m_animationClock.start();
+    m_animationTimer = new QTimer(this);
+    m_animationTimer->setTimerType(Qt::PreciseTimer);
+    m_animationTimer->setInterval(s_frameInterval);
+    connect(m_animationTimer, &QTimer::timeout, this, &ImagesCarousel::_onAnimationFrame);
+
     // Auto focus when scrolling
     m_scrollDebounceTimer = new QTimer(this);
     m_scrollDebounceTimer->setSingleShot(true);
@@ -60,6 +92,7 @@ ImagesCarousel::ImagesCarousel(const Config::StyleConfigItems& styleConfig,
             this,
             [this](int value) {
                 m_pendingScrollValue = value;
+                _updateLoadFocus(value);
                 if (m_suppressAutoFocus) {
                     return;
                 }
@@ -76,13 +109,32 @@ void ImagesCarousel::_onInitImagesLoaded() {
 }
 
 ImagesCarousel::~ImagesCarousel() {
-    delete ui;
-    // memory of items in m_loadedImages managed by Qt parent-child system
-    // ...
-    if (m_scrollAnimation) {
-        m_scrollAnimation->stop();
-        m_scrollAnimation->deleteLater();
+    // pending loads are skipped, running ones still use the carousel
+    blockSignals(true);
+    {
+        QMutexLocker locker(&m_stopSignMutex);
+        m_stopSign = true;
+    }
+    m_ioPool.waitForDone();
+    // nothing waits for the decodes and thumbnail requests that have not started
+    m_decodePool.clear();
+    m_decodePool.waitForDone();
+    {
+        // loaded but never drained into items
+        QMutexLocker locker(&m_loadedQueueMutex);
+        qDeleteAll(m_loadedQueue);
+        m_loadedQueue.clear();
     }
+    m_animationTimer->stop();
+    m_animatingItems.clear();
+    // items are plain records, not part of the Qt parent-child system
+    m_resizedItems.clear();
+    m_residentItems.clear();
+    m_focusTierItems.clear();
+    m_itemsByPath.clear();
+    qDeleteAll(m_loadedImages);
+    m_loadedImages.clear();
+    delete ui;
 }
 
 void ImagesCarousel::appendImages(const QStringList& paths) {
@@ -91,27 +143,36 @@ void ImagesCarousel::appendImages(const QStringList& paths) {
         emit loadingCompleted(0);
         return;
     }
+    emit loadingStarted(paths.size());
+    _startLoaders(paths);
+}
+
+void ImagesCarousel::_startLoaders(const QStringList& paths) {
     {
         QMutexLocker locker(&m_countMutex);
         m_addedImagesCount += paths.size();
     }
     m_loadedImages.reserve(m_loadedImages.size() + paths.size());
-    emit loadingStarted(paths.size());
-    for (const QString& path : paths) {
-        ImageLoader* loader = new ImageLoader(path, this);
-        QThreadPool::globalInstance()->start(loader);
+    m_loadScheduler.enqueue(paths);
+    // Each loader picks the most urgent pending paths when it actually runs
+    for (qsizetype i = 0; i < paths.size(); i += s_fetchBatchSize) {
+        const int count     = static_cast<int>(qMin<qsizetype>(s_fetchBatchSize, paths.size() - i));
+        ImageLoader* loader = new ImageLoader(this, count);
+        m_ioPool.start(loader);
     }
 }
 
-ImageLoader::ImageLoader(const QString& path, ImagesCarousel* carousel)
-    : m_path(path),
-      m_carousel(carousel),
-      m_initWidth(carousel->m_itemFocusWidth),
-      m_initHeight(carousel->m_itemFocusHeight) {
+ImageLoader::ImageLoader(ImagesCarousel* carousel, int count)
+    : m_carousel(carousel),
+      m_count(count),
+      m_initWidth(carousel->m_itemWidth),
+      m_initHeight(carousel->m_itemHeight),
+      m_queuedAt(Trace::isEnabled() ? Trace::now() : -1) {
     setAutoDelete(true);
 }
 
-void ImagesCarousel::_insertImage(const ImageData* data) {
+void ImagesCarousel::_insertImage(ImageData* data) {
+    TRACE_SPAN("insert_image", data->file.filePath());
     auto item = new ImageItem(
         data,
         m_itemWidth,
@@ -120,89 +181,368 @@ void ImagesCarousel::_insertImage(const ImageData* data) {
         m_itemFocusHeight,
         this);
 
-    static const QVector<std::function<bool(const ImageItem*, const ImageItem*)>> cmpFuncs = {
-        [](auto, auto) {
-            return false;
-        },  // None
-        [](auto a, auto b) {
-            return a->getFileName() < b->getFileName();
-        },
-        [](auto a, auto b) {
-            return a->getFileDate() < b->getFileDate();
-        },
-        [](auto a, auto b) {
-            return a->getFileSize() < b->getFileSize();
-        },
-    };
+    item->m_sequence = m_insertedCount++;
+    m_itemsByPath.insert(item->getFilePath(), item);
+    if (item->isResident()) {
+        _addResident(item);
+    }
 
     // insert into correct position based on sort type and direction
-    qint64 inserPos = m_loadedImages.size();
-    if (m_sortType != Config::SortType::None) {
-        for (auto it = m_loadedImages.rbegin();
-             it != m_loadedImages.rend() &&
-             cmpFuncs[static_cast<int>(m_sortType)](*it, item) == m_sortReverse;
-             (*it)->m_index++, ++it, --inserPos);
-    }
-    item->m_index = inserPos;
-    connect(item,
-            &ImageItem::clicked,
-            this,
-            &ImagesCarousel::_onItemClicked);
-    m_loadedImages.insert(inserPos, item);
-    m_imagesLayout->insertWidget(inserPos, item);
+    const auto it = std::lower_bound(m_loadedImages.begin(),
+                                     m_loadedImages.end(),
+                                     item,
+                                     [this](const ImageItem* a, const ImageItem* b) {
+                                         return _itemOrderedBefore(a, b);
+                                     });
+    const qsizetype insertPos = it - m_loadedImages.begin();
+    m_loadedImages.insert(insertPos, item);
+
+    // keep the focus on the same item
+    if (m_hasFocus && insertPos <= m_currentIndex) {
+        m_currentIndex++;
+    }
+}
+
+void ImagesCarousel::_completePlaceholder(ImageItem* item, ImageData* data) {
+    TRACE_SPAN("complete_placeholder", data->file.filePath());
+    item->m_placeholder = false;
+    item->m_loadPending = false;
+    if (data->image.isNull()) {
+        _removeResident(item);
+        item->dropPixmap();
+        item->m_broken = true;
+    } else {
+        _replacePixmap(item, QPixmap::fromImage(std::move(data->image)), false);
+        // the focus tier may be wanted by now
+        _ensureThumbnail(item);
+    }
+    delete data;
+}
+
+void ImagesCarousel::_removeImage(ImageItem* item) {
+    const qsizetype index = _indexOf(item);
+    if (index < 0) {
+        return;
+    }
+    m_loadedImages.remove(index);
+    m_itemsByPath.remove(item->getFilePath());
+    m_resizedItems.removeOne(item);
+    m_animatingItems.removeOne(item);
+    m_focusTierItems.removeOne(item);
+    _removeResident(item);
+
+    // keep the focus on the same item, or on its successor if it was removed
+    if (m_hasFocus && index < m_currentIndex) {
+        m_currentIndex--;
+    } else if (m_hasFocus && index == m_currentIndex) {
+        m_hasFocus = false;
+    }
+    delete item;
+}
+
+void ImagesCarousel::applyLibraryChanges(const QStringList& added,
+                                         const QStringList& removed,
+                                         const QStringList& modified) {
+    const bool hadFocus = m_hasFocus;
+    // modified images may change their sort position as well, so they are loaded as new items
+    for (const auto& path : removed + modified) {
+        if (const auto item = m_itemsByPath.value(path, nullptr)) {
+            _removeImage(item);
+        }
+    }
+    if (hadFocus && !m_loadedImages.isEmpty()) {
+        // also re-centers the focused item and updates its position in the title
+        m_currentIndex = qMin<qsizetype>(m_currentIndex, m_loadedImages.size() - 1);
+        focusCurrImage();
+    }
+    _updateFocusTier();
+    _updateScrollRange();
+    m_scrollArea->viewport()->update();
 
-    emit imageLoaded(m_loadedImages.size());
     {
-        QMutexLocker countLocker(&m_countMutex);
-        if (++m_loadedImagesCount >= m_addedImagesCount) {
-            QMutexLocker stopSignLocker(&m_stopSignMutex);
-            if (m_stopSign) {
-                // if all stopped
-                emit stopped();
-            } else {
-                emit loadingCompleted(m_loadedImagesCount);
+        QMutexLocker locker(&m_stopSignMutex);
+        if (m_stopSign) {
+            return;  // loading was stopped by the user
+        }
+    }
+    const auto paths = added + modified;
+    if (!paths.isEmpty()) {
+        _startLoaders(paths);
+    }
+}
+
+void ImagesCarousel::_enqueueLoaded(ImageData* data) {
+    QMutexLocker locker(&m_loadedQueueMutex);
+    m_loadedQueue.enqueue(data);
+    if (!m_drainScheduled) {
+        m_drainScheduled = true;
+        QMetaObject::invokeMethod(this, "_drainLoaded", Qt::QueuedConnection);
+    }
+}
+
+void ImagesCarousel::_drainLoaded() {
+    TRACE_SPAN("drain_loaded");
+    QElapsedTimer timer;
+    timer.start();
+
+    // integrate as many results as fit into the frame budget,
+    // leaving the rest of the frame to input handling and animations
+    int integrated = 0;
+    int completed  = 0;  // not counting placeholders
+    bool drained   = false;
+    while (timer.elapsed() < s_frameBudget) {
+        ImageData* data = nullptr;
+        {
+            QMutexLocker locker(&m_loadedQueueMutex);
+            if (m_loadedQueue.isEmpty()) {
+                // producers schedule the next drain from now on
+                m_drainScheduled = false;
+                drained          = true;
+                break;
+            }
+            data = m_loadedQueue.dequeue();
+        }
+        // placeholders are always inserted before the image they stand for
+        const auto existing = m_itemsByPath.value(data->file.filePath(), nullptr);
+        if (existing && existing->isPlaceholder() && !data->placeholder) {
+            _completePlaceholder(existing, data);
+            completed++;
+        } else {
+            if (existing) {
+                // loaded again, e.g. modified while the earlier load was running
+                _removeImage(existing);
             }
+            if (!data->placeholder) {
+                completed++;
+            }
+            _insertImage(data);
         }
+        integrated++;
+    }
+    if (!drained) {
+        const int delay = static_cast<int>(qMax<qint64>(0, s_frameInterval - timer.elapsed()));
+        QTimer::singleShot(delay, this, &ImagesCarousel::_drainLoaded);
+    }
+    if (integrated == 0) {
+        return;
+    }
+
+    // the neighbors of the focused item may have changed
+    _updateFocusTier();
+    _updateScrollRange();
+    m_scrollArea->viewport()->update();
+
+    // one progress update per batch
+    emit imageLoaded(m_loadedImages.size());
+    _addLoaded(completed);
+}
+
+void ImagesCarousel::_addLoaded(int count) {
+    if (count <= 0) {
+        return;
+    }
+    QMutexLocker countLocker(&m_countMutex);
+    m_loadedImagesCount += count;
+    if (m_loadedImagesCount >= m_addedImagesCount) {
+        QMutexLocker stopSignLocker(&m_stopSignMutex);
+        if (m_stopSign) {
+            // if all stopped
+            emit stopped();
+        } else {
+            emit loadingCompleted(m_loadedImagesCount);
+        }
+    }
+}
+
+bool ImagesCarousel::_itemOrderedBefore(const ImageItem* a, const ImageItem* b) const {
+    const int cmp = ImageSortKey::compare(a->getSortKey(), b->getSortKey(), m_sortType);
+    if (cmp != 0) {
+        return m_sortReverse ? cmp > 0 : cmp < 0;
     }
+    // equal keys keep the order of arrival, which makes the order total
+    return a->m_sequence < b->m_sequence;
+}
+
+qsizetype ImagesCarousel::_indexOf(const ImageItem* item) const {
+    const auto it = std::lower_bound(m_loadedImages.begin(),
+                                     m_loadedImages.end(),
+                                     item,
+                                     [this](const ImageItem* a, const ImageItem* b) {
+                                         return _itemOrderedBefore(a, b);
+                                     });
+    if (it == m_loadedImages.end() || *it != item) {
+        return -1;
+    }
+    return it - m_loadedImages.begin();
 }
 
 void ImageLoader::run() {
+    const QSize targetSize(m_initWidth, m_initHeight);
+    QVector<FetchedImage> batch;
+    batch.reserve(m_count);
+    for (int i = 0; i < m_count; i++) {
+        if (m_carousel->_skipStopped()) {
+            continue;
+        }
+        QString path;
+        if (!m_carousel->m_loadScheduler.takeNext(path)) {
+            // enqueued while still pending, so loaded by another slot
+            m_carousel->_addLoaded(m_count - i);
+            break;
+        }
+        if (m_queuedAt >= 0) {
+            Trace::record("queue_wait", m_queuedAt, path);
+        }
+        const auto cacheKey = ThumbnailCache::makeKey(QFileInfo(path).absoluteFilePath(), targetSize);
+        batch.append({path, targetSize, cacheKey, FileContents()});
+    }
+
+    // roughly the order on disk, which saves seeks on rotating disks
+    std::sort(batch.begin(), batch.end(), [](const FetchedImage& a, const FetchedImage& b) {
+        return a.cacheKey.inode < b.cacheKey.inode;
+    });
+
+    // let the kernel read the whole batch ahead while the first files are consumed,
+    // images with a cached thumbnail do not need their source at all
+    const auto cache = ThumbnailCache::instance();
+    QVector<int> fds(batch.size(), -1);
     {
-        QMutexLocker countLocker(&m_carousel->m_countMutex);
-        QMutexLocker stopSignLocker(&m_carousel->m_stopSignMutex);
-        if (m_carousel->m_stopSign) {
-            // if all stopped
-            if (++m_carousel->m_loadedImagesCount == m_carousel->m_addedImagesCount) {
-                emit m_carousel->stopped();
+        TRACE_SPAN("readahead");
+        for (qsizetype i = 0; i < batch.size(); i++) {
+            if (!batch[i].cacheKey.isValid() || cache->contains(batch[i].cacheKey)) {
+                continue;
+            }
+            fds[i] = ::open(QFile::encodeName(batch[i].path).constData(), O_RDONLY | O_CLOEXEC);
+            if (fds[i] >= 0) {
+                ::posix_fadvise(fds[i], 0, 0, POSIX_FADV_WILLNEED);
+            }
+        }
+    }
+
+    for (qsizetype i = 0; i < batch.size(); i++) {
+        auto& fetched = batch[i];
+        // the size may have changed since stat, but it is only a budget
+        const int budgetKb = static_cast<int>(qBound<qint64>(1, fetched.cacheKey.size / 1024, ImagesCarousel::s_fetchBudgetMb * 1024));
+        m_carousel->m_fetchBudget.acquire(budgetKb);
+
+        if (fds[i] >= 0) {
+            // decoded from the file by path if this fails
+            TRACE_SPAN(m_carousel->m_fetchMode == FileContents::Map ? "map" : "read", fetched.path);
+            fetched.contents = FileContents::fetch(fds[i], fetched.cacheKey.size, m_carousel->m_fetchMode);
+            ::close(fds[i]);
+        }
+
+        // photos from cameras and phones carry a small preview, shown until the decode stage is done
+        if (!fetched.contents.isNull()) {
+            const QImage preview = ImageDecoder::decodePreview(fetched.contents.bytes(), fetched.targetSize, fetched.path);
+            if (!preview.isNull()) {
+                fetched.hasPlaceholder = true;
+                m_carousel->_enqueueLoaded(new ImageData(fetched, m_carousel->m_sortType, preview));
             }
-            return;
         }
+
+        const auto carousel = m_carousel;
+        carousel->m_decodePool.start([carousel, fetched = std::move(fetched), budgetKb]() mutable {
+            carousel->_decodeFetched(fetched, budgetKb);
+        });
     }
-    auto data = new ImageData(m_path, m_initWidth, m_initHeight);
-    QMetaObject::invokeMethod(m_carousel,
-                              "_insertImage",
-                              Qt::QueuedConnection,
-                              Q_ARG(const ImageData*, data));
 }
 
-ImageData::ImageData(const QString& p, const int initWidth, const int initHeight) : file(p) {
-    if (!image.load(p)) {
-        warn(QString("Failed to load image from path: %1").arg(p));
-        return;
+bool ImagesCarousel::_skipStopped() {
+    QMutexLocker countLocker(&m_countMutex);
+    QMutexLocker stopSignLocker(&m_stopSignMutex);
+    if (!m_stopSign) {
+        return false;
+    }
+    // if all stopped
+    if (++m_loadedImagesCount == m_addedImagesCount) {
+        emit stopped();
+    }
+    return true;
+}
+
+void ImagesCarousel::_decodeFetched(FetchedImage& fetched, int budgetKb) {
+    if (fetched.hasPlaceholder || !_skipStopped()) {
+        auto data = new ImageData(fetched, m_sortType);
+        _enqueueLoaded(data);
+    }
+    // the contents are not needed any more, unmap them or make room for the next read
+    fetched.contents.release();
+    m_fetchBudget.release(budgetKb);
+}
+
+ImageData::ImageData(const QString& p,
+                     const int initWidth,
+                     const int initHeight,
+                     const Config::SortType sortType)
+    : ImageData(FetchedImage{p,
+                             QSize(initWidth, initHeight),
+                             ThumbnailCache::makeKey(QFileInfo(p).absoluteFilePath(), QSize(initWidth, initHeight)),
+                             FileContents()},
+                sortType) {
+}
+
+ImageData::ImageData(const FetchedImage& fetched,
+                     const Config::SortType sortType)
+    : file(fetched.path) {
+    TRACE_SPAN("load_image", fetched.path);
+
+    // the cache key already holds everything from stat(), reuse it for sorting
+    const auto& cacheKey = fetched.cacheKey;
+    sortKey              = ImageSortKey::make(fetched.path, sortType, cacheKey.mtimeNs, cacheKey.size);
+
+    bool rejected = false;
+    image         = loadThumbnail(fetched.path, fetched.targetSize, cacheKey, fetched.contents.bytes(), &rejected);
+    if (image.isNull()) {
+        warn(QString("Failed to load image from path: %1").arg(fetched.path));
+        // skipped by the next scans until modified, other failures are retried by the next run
+        if (rejected) {
+            RejectedImageCache::instance()->insert(fetched.path, cacheKey.mtimeNs);
+        }
+    }
+}
+
+ImageData::ImageData(const FetchedImage& fetched,
+                     const Config::SortType sortType,
+                     const QImage& preview)
+    : file(fetched.path),
+      image(preview),
+      sortKey(ImageSortKey::make(fetched.path, sortType, fetched.cacheKey.mtimeNs, fetched.cacheKey.size)),
+      placeholder(true) {
+}
+
+QImage ImageData::loadThumbnail(const QString& path,
+                                const QSize& targetSize,
+                                const ThumbnailCache::Key& cacheKey,
+                                const QByteArray& contents,
+                                bool* rejected) {
+    const auto cache = ThumbnailCache::instance();
+    if (rejected) {
+        *rejected = false;
     }
-    // resize in "cover" mode
-    const QSize targetSize(initWidth, initHeight);
-    image = image.scaled(targetSize, Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
 
-    // Crop to center
-    int x = (image.width() - targetSize.width()) / 2;
-    int y = (image.height() - targetSize.height()) / 2;
-    image = image.copy(x, y, targetSize.width(), targetSize.height());
+    // try the cropped thumbnail from the last run first
+    QImage image;
+    {
+        TRACE_SPAN("cache_load", path);
+        if (cache->load(cacheKey, image)) {
+            return image;
+        }
+    }
+
+    image = contents.isEmpty() ? ImageDecoder::decodeCover(path, targetSize, rejected)
+                               : ImageDecoder::decodeCover(contents, targetSize, path, rejected);
+    if (!image.isNull()) {
+        TRACE_SPAN("cache_store", path);
+        cache->store(cacheKey, image);
+    }
+    return image;
 }
 
 void ImagesCarousel::focusNextImage() {
     unfocusCurrImage();
     if (m_loadedImages.size() <= 1) return;
+    _recordNavigation(1);
     m_currentIndex++;
     if (m_currentIndex >= m_loadedImages.size()) {
         m_currentIndex = 0;
@@ -212,6 +552,7 @@ void ImagesCarousel::focusNextImage() {
 
 void ImagesCarousel::focusPrevImage() {
     if (m_loadedImages.size() <= 1) return;
+    _recordNavigation(-1);
     unfocusCurrImage();
     m_currentIndex--;
     if (m_currentIndex < 0) {
@@ -226,6 +567,7 @@ void ImagesCarousel::unfocusCurrImage() {
         return;
     }
     m_loadedImages[m_currentIndex]->setFocus(false);
+    m_hasFocus = false;
 }
 
 void ImagesCarousel::focusCurrImage() {
@@ -234,51 +576,27 @@ void ImagesCarousel::focusCurrImage() {
         return;
     }
     m_loadedImages[m_currentIndex]->setFocus(true);
+    m_hasFocus = true;
+    _updateFocusTier();
+    m_loadScheduler.setFocus(m_loadedImages[m_currentIndex]->getFilePath());
     emit imageFocused(m_loadedImages[m_currentIndex]->getFileFullPath(),
                       m_currentIndex,
                       m_loadedImages.size());
-    auto hScrollBar  = ui->scrollArea->horizontalScrollBar();
-    int spacing      = ui->scrollAreaWidgetContents->layout()->spacing();
+    int spacing      = s_itemSpacing;
     int centerOffset = (m_itemWidth + spacing) * m_currentIndex + m_itemFocusWidth / 2 - spacing;
     int leftOffset   = centerOffset - ui->scrollArea->width() / 2;
     if (leftOffset < 0) {
         leftOffset = 0;
     }
 
-    if (m_scrollAnimation) {
-        m_scrollAnimation->stop();
-        m_scrollAnimation->deleteLater();
-        m_scrollAnimation = nullptr;
-    }
-
-    m_scrollAnimation = new QPropertyAnimation(hScrollBar, "value");
-    m_scrollAnimation->setDuration(s_animationDuration);
-    m_scrollAnimation->setStartValue(hScrollBar->value());
-    m_scrollAnimation->setEndValue(leftOffset);
-    m_scrollAnimation->setEasingCurve(QEasingCurve::OutCubic);
-
-    // Suppress auto focus during animation
-    connect(m_scrollAnimation,
-            &QPropertyAnimation::finished,
-            this,
-            [this]() {
-                m_suppressAutoFocus = false;
-                m_scrollArea->setBlockInput(false);
-            });
-    m_suppressAutoFocus = true;
-    m_scrollArea->setBlockInput(true);
-    m_scrollAnimation->start();
+    _animateScroll(leftOffset);
 }
 
 void ImagesCarousel::_onScrollBarValueChanged(int value) {
     // Stop the animation if it is running
-    if (m_scrollAnimation && m_scrollAnimation->state() == QPropertyAnimation::Running) {
-        m_scrollAnimation->stop();
-        m_scrollAnimation->deleteLater();
-        m_scrollAnimation = nullptr;
-    }
+    _stopScrollAnimation();
     int centerOffset = (value + m_itemFocusWidth / 2);
-    int itemOffset   = m_itemWidth + ui->scrollAreaWidgetContents->layout()->spacing();
+    int itemOffset   = m_itemWidth + s_itemSpacing;
     int index        = centerOffset / itemOffset;
 
     if (index < 0 || index >= m_loadedImages.size()) {
@@ -287,11 +605,21 @@ void ImagesCarousel::_onScrollBarValueChanged(int value) {
     if (index == m_currentIndex) {
         return;  // Already focused
     }
+    _recordNavigation(index > m_currentIndex ? 1 : -1);
     unfocusCurrImage();
     m_currentIndex = index;
     focusCurrImage();
 }
 
+void ImagesCarousel::_updateLoadFocus(int scrollValue) {
+    // load around whatever is in the middle of the viewport while scrolling freely
+    const int index = _firstVisibleIndex(scrollValue + m_scrollArea->viewport()->width() / 2);
+    if (index < 0 || index >= m_loadedImages.size()) {
+        return;
+    }
+    m_loadScheduler.setFocus(m_loadedImages[index]->getFilePath());
+}
+
 void ImagesCarousel::_onItemClicked(int index) {
     // if (m_suppressAutoFocus) return;
     unfocusCurrImage();
@@ -302,54 +630,461 @@ void ImagesCarousel::_onItemClicked(int index) {
     focusCurrImage();
 }
 
-ImageItem::ImageItem(const ImageData* data,
+ImageItem::ImageItem(ImageData* data,
                      const int itemWidth,
                      const int itemHeight,
                      const int itemFocusWidth,
                      const int itemFocusHeight,
-                     QWidget* parent)
-    : QLabel(parent),
-      m_data(data),
+                     ImagesCarousel* carousel)
+    : m_data(data),
+      m_carousel(carousel),
       m_itemSize(itemWidth, itemHeight),
       m_itemFocusSize(itemFocusWidth, itemFocusHeight) {
     assert(data != nullptr);
-    setScaledContents(true);
     if (data->image.isNull()) {
-        setText(":(");
-        setAlignment(Qt::AlignCenter);
-    } else {
-        setPixmap(QPixmap::fromImage(data->image));
+        m_broken = true;
+        return;
     }
-    setFixedSize(itemWidth, itemHeight);
+    // the pixmap is the only copy of the pixels from now on
+    m_pixmap    = QPixmap::fromImage(std::move(data->image));
+    data->image = QImage();
+
+    // the decoded image is on its way through the regular loading
+    m_placeholder = data->placeholder;
+    m_loadPending = data->placeholder;
 }
 
 ImageItem::~ImageItem() {
-    if (m_scaleAnimation) {
-        m_scaleAnimation->stop();
-        delete m_scaleAnimation;
-        m_scaleAnimation = nullptr;
-    }
     delete m_data;
 }
 
 void ImageItem::setFocus(bool focus) {
-    if (m_scaleAnimation) {
-        m_scaleAnimation->stop();
-        delete m_scaleAnimation;
-        m_scaleAnimation = nullptr;
-    }
-    m_scaleAnimation = new QPropertyAnimation(this, "size");
-    m_scaleAnimation->setDuration(ImagesCarousel::s_animationDuration);
-    m_scaleAnimation->setStartValue(size());
-    m_scaleAnimation->setEndValue(focus ? m_itemFocusSize : m_itemSize);
-    m_scaleAnimation->setEasingCurve(QEasingCurve::OutCubic);
-    connect(m_scaleAnimation,
-            &QPropertyAnimation::valueChanged,
-            this,
-            [this](const QVariant& value) {
-                setFixedSize(value.toSize());
-            });
-    m_scaleAnimation->start();
+    m_carousel->_animateItem(this, focus ? 1.0 : 0.0);
+}
+
+void ImageItem::paint(QPainter& painter, const QRect& rect) const {
+    if (m_broken) {
+        painter.drawText(rect, Qt::AlignCenter, ":(");
+        return;
+    }
+    if (m_pixmap.isNull()) {
+        // evicted, being reloaded
+        return;
+    }
+    painter.drawPixmap(rect, m_pixmap);
+}
+
+int ImagesCarousel::_itemOffset(int index) const {
+    int offset = s_itemSpacing + (m_itemWidth + s_itemSpacing) * index;
+    for (const auto item : m_resizedItems) {
+        if (_indexOf(item) < index) {
+            offset += item->width() - m_itemWidth;
+        }
+    }
+    return offset;
+}
+
+int ImagesCarousel::_contentWidth() const {
+    // room for one focused item is always reserved, so the scroll range
+    // stays put while items are animating;
+    // trailing spacing of the last item doubles as the right margin
+    return s_itemSpacing + (m_itemWidth + s_itemSpacing) * static_cast<int>(m_loadedImages.size()) +
+           (m_itemFocusWidth - m_itemWidth);
+}
+
+int ImagesCarousel::_firstVisibleIndex(int contentX) const {
+    // resized items only ever push their successors to the right,
+    // so start from a lower bound and walk forward
+    int extra = 0;
+    for (const auto item : m_resizedItems) {
+        extra += qMax(0, item->width() - m_itemWidth);
+    }
+    int index  = qMax(0, (contentX - s_itemSpacing - extra) / (m_itemWidth + s_itemSpacing));
+    int offset = _itemOffset(index);
+    while (index < m_loadedImages.size() && offset + m_loadedImages[index]->width() <= contentX) {
+        offset += m_loadedImages[index]->width() + s_itemSpacing;
+        index++;
+    }
+    return index;
+}
+
+int ImagesCarousel::_indexAt(const QPoint& contentPos, int viewportHeight) const {
+    const int index = _firstVisibleIndex(contentPos.x());
+    if (index >= m_loadedImages.size()) {
+        return -1;
+    }
+    const auto& size = m_loadedImages[index]->size();
+    const QRect rect(_itemOffset(index), (viewportHeight - size.height()) / 2, size.width(), size.height());
+    return rect.contains(contentPos) ? index : -1;
+}
+
+void ImagesCarousel::_updateResized(ImageItem* item) {
+    const bool resized = item->m_scale != 0.0;
+    const auto pos     = m_resizedItems.indexOf(item);
+    if (resized && pos < 0) {
+        m_resizedItems.append(item);
+    } else if (!resized && pos >= 0) {
+        m_resizedItems.remove(pos);
+    }
+}
+
+void ImagesCarousel::_animateItem(ImageItem* item, double targetScale) {
+    // continue from wherever a running animation currently is
+    item->m_scaleFrom  = item->m_scale;
+    item->m_scaleTo    = targetScale;
+    item->m_scaleStart = m_animationClock.elapsed();
+    if (!item->m_animating) {
+        item->m_animating = true;
+        m_animatingItems.append(item);
+    }
+    if (!m_animationTimer->isActive()) {
+        m_animationTimer->start();
+    }
+}
+
+void ImagesCarousel::_animateScroll(int targetValue) {
+    m_scrollFrom      = m_scrollArea->horizontalScrollBar()->value();
+    m_scrollTo        = targetValue;
+    m_scrollStart     = m_animationClock.elapsed();
+    m_scrollAnimating = true;
+
+    // Suppress auto focus during animation
+    m_suppressAutoFocus = true;
+    m_scrollArea->setBlockInput(true);
+    if (!m_animationTimer->isActive()) {
+        m_animationTimer->start();
+    }
+}
+
+void ImagesCarousel::_stopScrollAnimation() {
+    if (!m_scrollAnimating) {
+        return;
+    }
+    m_scrollAnimating   = false;
+    m_suppressAutoFocus = false;
+    m_scrollArea->setBlockInput(false);
+}
+
+void ImagesCarousel::_onAnimationFrame() {
+    const qint64 now      = m_animationClock.elapsed();
+    const auto progressOf = [now](qint64 start) {
+        return qBound(0.0, static_cast<double>(now - start) / s_animationDuration, 1.0);
+    };
+
+    // an item growing and one shrinking at the same time keep the strip at constant width
+    for (auto it = m_animatingItems.begin(); it != m_animatingItems.end();) {
+        const auto item       = *it;
+        const double progress = progressOf(item->m_scaleStart);
+        item->m_scale         = item->m_scaleFrom + (item->m_scaleTo - item->m_scaleFrom) * m_easing.valueForProgress(progress);
+        _updateResized(item);
+        if (progress >= 1.0) {
+            item->m_animating = false;
+            it                = m_animatingItems.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (m_scrollAnimating) {
+        const double progress = progressOf(m_scrollStart);
+        const double value    = m_scrollFrom + (m_scrollTo - m_scrollFrom) * m_easing.valueForProgress(progress);
+        m_scrollArea->horizontalScrollBar()->setValue(qRound(value));
+        if (progress >= 1.0) {
+            _stopScrollAnimation();
+        }
+    }
+
+    if (m_animatingItems.isEmpty() && !m_scrollAnimating) {
+        m_animationTimer->stop();
+    }
+    m_scrollArea->viewport()->update();
+}
+
+void ImagesCarousel::_updateScrollRange() {
+    auto hScrollBar     = m_scrollArea->horizontalScrollBar();
+    const int viewWidth = m_scrollArea->viewport()->width();
+    hScrollBar->setRange(0, qMax(0, _contentWidth() - viewWidth));
+    hScrollBar->setPageStep(viewWidth);
+    hScrollBar->setSingleStep(m_itemWidth + s_itemSpacing);
+}
+
+void ImagesCarousel::_paintItems(QPainter& painter, const QRect& contentRect) {
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.setPen(m_scrollArea->palette().color(QPalette::WindowText));
+    const int scrollX = contentRect.x();
+    int index         = _firstVisibleIndex(scrollX);
+    int offset        = _itemOffset(index);
+    m_paintSerial++;
+    for (; index < m_loadedImages.size() && offset < scrollX + contentRect.width(); index++) {
+        const auto item  = m_loadedImages[index];
+        const auto& size = item->size();
+
+        // visible items are the last ones to be evicted
+        item->m_lastPaintSerial = m_paintSerial;
+        if (item->isResident()) {
+            _touchResident(item);
+        } else {
+            _ensureThumbnail(item);
+        }
+
+        item->paint(painter, QRect(offset - scrollX, (contentRect.height() - size.height()) / 2, size.width(), size.height()));
+        offset += size.width() + s_itemSpacing;
+    }
+}
+
+void ImagesCarousel::_addResident(ImageItem* item) {
+    if (item->m_inResidentList) {
+        return;
+    }
+    m_residentItems.push_front(item);
+    item->m_residentIt     = m_residentItems.begin();
+    item->m_inResidentList = true;
+    m_residentBytes += item->getPixmapBytes();
+}
+
+void ImagesCarousel::_removeResident(ImageItem* item) {
+    if (!item->m_inResidentList) {
+        return;
+    }
+    m_residentBytes -= item->getPixmapBytes();
+    m_residentItems.erase(item->m_residentIt);
+    item->m_inResidentList = false;
+}
+
+void ImagesCarousel::_touchResident(ImageItem* item) {
+    if (!item->m_inResidentList) {
+        _addResident(item);
+        return;
+    }
+    // splicing keeps the iterator valid
+    m_residentItems.splice(m_residentItems.begin(), m_residentItems, item->m_residentIt);
+}
+
+void ImagesCarousel::_evictResidents() {
+    if (m_memoryBudget <= 0) {
+        return;
+    }
+    int evicted = 0;
+    auto it     = m_residentItems.end();
+    while (m_residentBytes > m_memoryBudget && it != m_residentItems.begin()) {
+        const auto next = it;
+        const auto item = *--it;
+        if (item->m_lastPaintSerial == m_paintSerial && m_paintSerial != 0) {
+            continue;  // painted in the last frame
+        }
+        if (item->m_wantsFocusTier) {
+            continue;  // focused, next to the focused item or prefetched
+        }
+        _removeResident(item);
+        item->dropPixmap();
+        evicted++;
+        it = next;
+    }
+    if (evicted > 0) {
+        LOG_INFO(QString("Evicted %1 thumbnails from memory, %2 MiB resident")
+                     .arg(evicted)
+                     .arg(m_residentBytes / 1024 / 1024),
+                 GeneralLogger::DETAIL);
+    }
+}
+
+void ImagesCarousel::_replacePixmap(ImageItem* item, const QPixmap& pixmap, bool focusTier) {
+    if (item->m_inResidentList) {
+        m_residentBytes -= item->getPixmapBytes();
+        item->setPixmap(pixmap, focusTier);
+        m_residentBytes += item->getPixmapBytes();
+        return;
+    }
+    item->setPixmap(pixmap, focusTier);
+    _addResident(item);
+}
+
+void ImagesCarousel::_updateFocusTier() {
+    QVector<ImageItem*> items;
+    qsizetype neighborCount = 0;
+    if (m_hasFocus) {
+        const qsizetype first = qMax<qsizetype>(0, m_currentIndex - s_focusTierRadius);
+        const qsizetype last  = qMin<qsizetype>(m_loadedImages.size() - 1, m_currentIndex + s_focusTierRadius);
+        for (qsizetype i = first; i <= last; i++) {
+            items.append(m_loadedImages[i]);
+        }
+        neighborCount = items.size();
+
+        // ahead in the direction of navigation, wrapping around like focusNextImage and focusPrevImage
+        const qsizetype count = m_loadedImages.size();
+        const qsizetype ahead = m_navigationDirection == 0 ? 0 : qMin<qsizetype>(_prefetchCount(), count - 1);
+        for (qsizetype i = 1; i <= ahead; i++) {
+            const qsizetype index = ((m_currentIndex + m_navigationDirection * i) % count + count) % count;
+            if (!items.contains(m_loadedImages[index])) {
+                items.append(m_loadedImages[index]);
+            }
+        }
+    }
+    for (const auto item : m_focusTierItems) {
+        if (!items.contains(item)) {
+            item->m_wantsFocusTier = false;
+            if (item->isResident()) {
+                _ensureThumbnail(item);
+            }
+        }
+    }
+    for (qsizetype i = 0; i < items.size(); i++) {
+        items[i]->m_wantsFocusTier = true;
+        _ensureThumbnail(items[i], i < neighborCount ? 0 : m_prefetchGeneration.load());
+    }
+    m_focusTierItems = std::move(items);
+    _evictResidents();
+}
+
+void ImagesCarousel::_ensureThumbnail(ImageItem* item, quint64 generation) {
+    if (item->isBroken() || item->m_loadPending) {
+        return;
+    }
+    const bool wantsFocusTier = item->m_wantsFocusTier;
+    if (item->isResident()) {
+        if (item->isFocusTier() == wantsFocusTier) {
+            return;
+        }
+        if (!wantsFocusTier) {
+            // shrinking the pixmap is cheap enough to do right away
+            _replacePixmap(item,
+                           item->m_pixmap.scaled(m_itemWidth,
+                                                 m_itemHeight,
+                                                 Qt::IgnoreAspectRatio,
+                                                 Qt::SmoothTransformation),
+                           false);
+            return;
+        }
+    }
+    _requestThumbnail(item, wantsFocusTier, generation);
+}
+
+void ImagesCarousel::_requestThumbnail(ImageItem* item, bool focusTier, quint64 generation) {
+    item->m_loadPending = true;
+
+    // from the disk cache in most cases, ahead of the regular decodes
+    const QString path     = item->getFilePath();
+    const QString absPath  = item->getFileFullPath();
+    const QSize targetSize = focusTier ? QSize(m_itemFocusWidth, m_itemFocusHeight)
+                                       : QSize(m_itemWidth, m_itemHeight);
+    const qint64 queuedAt = Trace::isEnabled() ? Trace::now() : -1;
+    // on a pool of the carousel, which its destructor waits for before anything used here is gone
+    m_decodePool.start(
+        [this, path, absPath, targetSize, focusTier, generation, queuedAt]() {
+            if (queuedAt >= 0) {
+                Trace::record("queue_wait", queuedAt, path);
+            }
+            // prefetching for a direction that has been abandoned
+            if (generation != 0 && m_prefetchGeneration != generation) {
+                QMetaObject::invokeMethod(
+                    this,
+                    [this, path]() {
+                        _onThumbnailCancelled(path);
+                    },
+                    Qt::QueuedConnection);
+                return;
+            }
+            const auto cacheKey = ThumbnailCache::makeKey(absPath, targetSize);
+            QImage image        = ImageData::loadThumbnail(path, targetSize, cacheKey);
+            QMetaObject::invokeMethod(
+                this,
+                [this, path, image, focusTier]() {
+                    _onThumbnailLoaded(path, image, focusTier);
+                },
+                Qt::QueuedConnection);
+        },
+        generation != 0 ? s_prefetchPriority : s_visiblePriority);
+}
+
+void ImagesCarousel::_onThumbnailLoaded(const QString& path, const QImage& image, bool focusTier) {
+    const auto item = m_itemsByPath.value(path, nullptr);
+    if (!item) {
+        return;
+    }
+    item->m_loadPending = false;
+    if (image.isNull()) {
+        warn(QString("Failed to reload image from path: %1").arg(path));
+        if (!item->isResident()) {
+            item->m_broken = true;
+        }
+        m_scrollArea->viewport()->update();
+        return;
+    }
+    _replacePixmap(item, QPixmap::fromImage(image), focusTier);
+
+    // the wanted tier may have changed while loading
+    _ensureThumbnail(item);
+    _evictResidents();
+    m_scrollArea->viewport()->update();
+}
+
+void ImagesCarousel::_onThumbnailCancelled(const QString& path) {
+    const auto item = m_itemsByPath.value(path, nullptr);
+    if (!item) {
+        return;
+    }
+    item->m_loadPending = false;
+    if (item->m_wantsFocusTier) {
+        // still within the current window
+        _updateFocusTier();
+    }
+}
+
+void ImagesCarousel::_recordNavigation(int direction) {
+    const qint64 interval = m_navigationClock.isValid() ? m_navigationClock.restart() : -1;
+    if (interval < 0) {
+        m_navigationClock.start();
+    }
+    if (direction != m_navigationDirection) {
+        // cancel whatever was prefetched for the other direction
+        m_navigationDirection = direction;
+        m_navigationVelocity  = 0.0;
+        m_prefetchGeneration++;
+    } else if (interval > 0 && interval < s_navigationIdle) {
+        m_navigationVelocity = m_navigationVelocity * 0.5 + 1000.0 / interval * 0.5;
+    } else {
+        m_navigationVelocity = 0.0;
+    }
+}
+
+int ImagesCarousel::_prefetchCount() const {
+    // the configured window at least, more when navigating fast enough to outrun it
+    const int byVelocity = static_cast<int>(std::ceil(m_navigationVelocity * s_prefetchHorizon / 1000.0));
+    return qMin(qMax(m_prefetchCount, byVelocity), m_prefetchCount * 4);
+}
+
+void ImagesCarouselScrollArea::paintEvent(QPaintEvent* event) {
+    Q_UNUSED(event);
+    if (!m_carousel) {
+        return;
+    }
+    QPainter painter(viewport());
+    const QRect contentRect(horizontalScrollBar()->value(), 0, viewport()->width(), viewport()->height());
+    m_carousel->_paintItems(painter, contentRect);
+}
+
+void ImagesCarouselScrollArea::mousePressEvent(QMouseEvent* event) {
+    if (m_carousel && event->button() == Qt::LeftButton) {
+        const QPoint contentPos = event->pos() + QPoint(horizontalScrollBar()->value(), 0);
+        const int index         = m_carousel->_indexAt(contentPos, viewport()->height());
+        if (index >= 0) {
+            emit itemClicked(index);
+        }
+    }
+    QAbstractScrollArea::mousePressEvent(event);
+}
+
+void ImagesCarouselScrollArea::resizeEvent(QResizeEvent* event) {
+    QAbstractScrollArea::resizeEvent(event);
+    if (m_carousel) {
+        m_carousel->_updateScrollRange();
+    }
+}
+
+void ImagesCarouselScrollArea::scrollContentsBy(int dx, int dy) {
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    viewport()->update();
 }
 
 void ImagesCarousel::onStop() {
@@ -1,7 +1,7 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-05 01:22:53
- * @LastEditTime: 2025-08-08 04:17:53
+ * @LastEditTime: 2026-10-26 14:40:13
  * @Description: Animated carousel widget for displaying and selecting images.
  */
 #ifndef IMAGES_CAROUSEL_H
@@ -9,22 +9,30 @@
 
 #include <qtmetamacros.h>
 
+#include <QAbstractScrollArea>
+#include <QEasingCurve>
+#include <QElapsedTimer>
 #include <QFileInfo>
-#include <QHBoxLayout>
+#include <QHash>
 #include <QKeyEvent>
-#include <QLabel>
 #include <QMutex>
 #include <QObject>
+#include <QPainter>
 #include <QPixmap>
-#include <QPropertyAnimation>
 #include <QQueue>
 #include <QRunnable>
-#include <QScrollArea>
+#include <QSemaphore>
 #include <QThreadPool>
 #include <QTimer>
 #include <QWidget>
+#include <atomic>
+#include <list>
 
 #include "config.h"
+#include "file_contents.h"
+#include "image_load_scheduler.h"
+#include "image_sort_key.h"
+#include "thumbnail_cache.h"
 
 class ImageData;
 class ImageItem;
@@ -32,77 +40,170 @@ class ImageLoader;
 class ImagesCarousel;
 class ImagesCarouselScrollArea;
 
+/**
+ * @brief Source of an image as read by the I/O stage of loading,
+ *        handed over to the decode stage.
+ */
+struct FetchedImage {
+    QString path;
+    QSize targetSize;  // of the thumbnail
+    ThumbnailCache::Key cacheKey;
+    FileContents contents;        // null if the thumbnail is expected in the cache, or if fetching failed
+    bool hasPlaceholder = false;  // shown already, the decode has to finish even if loading is stopped
+};
+
 /**
  * @brief Data structure to hold image information
  *        and can be safely created and passed between threads.
  */
 struct ImageData {
     QFileInfo file;
-    QImage image;
-
-    explicit ImageData(const QString& p, const int initWidth, const int initHeight);
+    QImage image;  // moved into the pixmap of ImageItem once integrated
+    ImageSortKey sortKey;
+    bool placeholder = false;  // low resolution preview, replaced once the image is decoded
+
+    explicit ImageData(const QString& p,
+                       const int initWidth,
+                       const int initHeight,
+                       const Config::SortType sortType);
+
+    // Decodes from fetched.contents if not null
+    explicit ImageData(const FetchedImage& fetched,
+                       const Config::SortType sortType);
+
+    // Placeholder showing preview until the ImageData decoded from fetched arrives
+    explicit ImageData(const FetchedImage& fetched,
+                       const Config::SortType sortType,
+                       const QImage& preview);
+
+    // Thumbnail from the cache, otherwise decoded (from contents if given) and stored to the cache.
+    // rejected as for ImageDecoder::decodeCover
+    static QImage loadThumbnail(const QString& path,
+                                const QSize& targetSize,
+                                const ThumbnailCache::Key& cacheKey,
+                                const QByteArray& contents = {},
+                                bool* rejected             = nullptr);
 };
 
 /**
- * @brief Image label that displays an image,
- *        which should always be created in the main thread.
+ * @brief Record of a loaded image as displayed in the carousel.
+ *        Items are not widgets, they are painted by ImagesCarouselScrollArea
+ *        only when intersecting the visible part of the strip,
+ *        and should always be created in the main thread.
  */
-class ImageItem : public QLabel {
-    Q_OBJECT
+class ImageItem {
+    friend class ImagesCarousel;  // resident item bookkeeping
 
   public:
-    explicit ImageItem(const ImageData* data,
+    // Takes over data, the pixels of which are moved into the item's pixmap
+    explicit ImageItem(ImageData* data,
                        const int itemWidth,
                        const int itemHeight,
                        const int itemFocusWidth,
                        const int itemFocusHeight,
-                       QWidget* parent = nullptr);
+                       ImagesCarousel* carousel);
+
+    ~ImageItem();
 
-    ~ImageItem() override;
+    ImageItem(const ImageItem&)            = delete;
+    ImageItem& operator=(const ImageItem&) = delete;
 
     [[nodiscard]] QString getFileFullPath() const { return m_data->file.absoluteFilePath(); }
 
+    // Path as passed to ImagesCarousel::appendImages
+    [[nodiscard]] QString getFilePath() const { return m_data->file.filePath(); }
+
     [[nodiscard]] QString getFileName() const { return m_data->file.fileName(); }
 
     [[nodiscard]] QDateTime getFileDate() const { return m_data->file.lastModified(); }
 
-    [[nodiscard]] const QImage& getThumbnail() const { return m_data->image; }
-
     [[nodiscard]] qint64 getFileSize() const { return m_data->file.size(); }
 
+    [[nodiscard]] const ImageSortKey& getSortKey() const { return m_data->sortKey; }
+
+    // Current (possibly animating) display size, interpolated between base and focus size
+    [[nodiscard]] QSize size() const {
+        return {m_itemSize.width() + qRound((m_itemFocusSize.width() - m_itemSize.width()) * m_scale),
+                m_itemSize.height() + qRound((m_itemFocusSize.height() - m_itemSize.height()) * m_scale)};
+    }
+
+    [[nodiscard]] int width() const {
+        return m_itemSize.width() + qRound((m_itemFocusSize.width() - m_itemSize.width()) * m_scale);
+    }
+
+    // Animated by ImagesCarousel
     void setFocus(bool focus = true);
 
-    int m_index = 0;
+    void paint(QPainter& painter, const QRect& rect) const;
 
-  protected:
-    void mousePressEvent(QMouseEvent* event) override {
-        emit clicked(m_index);
-        QLabel::mousePressEvent(event);
+    // Pixel data may be dropped under memory pressure and restored later
+    [[nodiscard]] bool isResident() const { return !m_pixmap.isNull(); }
+
+    [[nodiscard]] bool isBroken() const { return m_broken; }
+
+    // Showing the embedded preview until the image is decoded
+    [[nodiscard]] bool isPlaceholder() const { return m_placeholder; }
+
+    // Whether the pixmap is at focus size rather than base size
+    [[nodiscard]] bool isFocusTier() const { return m_focusTier; }
+
+    [[nodiscard]] qint64 getPixmapBytes() const {
+        return static_cast<qint64>(m_pixmap.width()) * m_pixmap.height() * m_pixmap.depth() / 8;
+    }
+
+    [[nodiscard]] const QPixmap& getPixmap() const { return m_pixmap; }
+
+    void setPixmap(const QPixmap& pixmap, bool focusTier) {
+        m_pixmap    = pixmap;
+        m_focusTier = focusTier;
     }
 
+    void dropPixmap() { m_pixmap = QPixmap(); }
+
+    // Order of arrival, breaks ties between equal sort keys.
+    // The index of an item is derived from its position instead of being stored.
+    quint64 m_sequence = 0;
+
   private:
     const ImageData* m_data;
+    ImagesCarousel* m_carousel;
+    QPixmap m_pixmap;
+    bool m_broken      = false;  // failed to load, nothing to restore
+    bool m_placeholder = false;
     QSize m_itemSize;
     QSize m_itemFocusSize;
-    QPropertyAnimation* m_scaleAnimation = nullptr;
-
-  signals:
-    void clicked(int index);
+    double m_scale = 0.0;  // 0 at base size, 1 at focus size
+
+    // Owned by ImagesCarousel
+    std::list<ImageItem*>::iterator m_residentIt;
+    bool m_inResidentList     = false;
+    bool m_loadPending        = false;  // a thumbnail is being loaded on the thread pool
+    bool m_focusTier          = false;
+    bool m_wantsFocusTier     = false;  // focused or next to the focused item
+    quint64 m_lastPaintSerial = 0;
+
+    // Animation state, advanced by ImagesCarousel::_onAnimationFrame
+    bool m_animating    = false;
+    double m_scaleFrom  = 0.0;
+    double m_scaleTo    = 0.0;
+    qint64 m_scaleStart = 0;  // ms on the animation clock
 };
 
 /**
- * @brief Worker class for loading images in a separate thread.
+ * @brief I/O stage of loading: reads a batch of the most urgent pending images
+ *        into memory and hands them over to the decode stage.
  */
 class ImageLoader : public QRunnable {
   public:
-    ImageLoader(const QString& path, ImagesCarousel* carousel);
+    explicit ImageLoader(ImagesCarousel* carousel, int count);
     void run() override;  // friend to ImagesCarousel
 
   private:
-    QString m_path;
     ImagesCarousel* m_carousel;
+    const int m_count;  // images in the batch
     const int m_initWidth;
     const int m_initHeight;
+    const qint64 m_queuedAt;  // on the trace clock, -1 if not tracing
 };
 
 namespace Ui {
@@ -113,15 +214,28 @@ class ImagesCarousel : public QWidget {
     Q_OBJECT
 
     friend void ImageLoader::run();
+    friend class ImageItem;
+    friend class ImagesCarouselScrollArea;
 
   public:
     explicit ImagesCarousel(const Config::StyleConfigItems& styleConfig,
                             const Config::SortConfigItems& sortConfig,
+                            const Config::LoadingConfigItems& loadingConfig,
                             QWidget* parent = nullptr);
     ~ImagesCarousel();
 
     static constexpr int s_debounceInterval  = 200;
     static constexpr int s_animationDuration = 300;
+    static constexpr int s_itemSpacing       = 6;
+    static constexpr int s_frameInterval     = 16;    // ms
+    static constexpr int s_frameBudget       = 4;     // ms per frame spent on integrating loaded images
+    static constexpr int s_visiblePriority   = 2;     // thread pool priority of reloading visible items
+    static constexpr int s_focusTierRadius   = 1;     // neighbors on each side kept at focus size
+    static constexpr int s_prefetchPriority  = 1;     // thread pool priority of prefetching
+    static constexpr int s_prefetchHorizon   = 500;   // ms of navigation at the current speed to prefetch for
+    static constexpr int s_navigationIdle    = 1000;  // ms after which navigation counts as a fresh start
+    static constexpr int s_fetchBatchSize    = 8;     // images read ahead together by one I/O job
+    static constexpr int s_fetchBudgetMb     = 128;   // file contents read ahead but not yet decoded
 
     [[nodiscard]] QString getCurrentImagePath() const {
         if (m_currentIndex < 0 || m_currentIndex >= m_loadedImages.size()) {
@@ -130,6 +244,13 @@ class ImagesCarousel : public QWidget {
         return m_loadedImages[m_currentIndex]->getFileFullPath();
     }
 
+    [[nodiscard]] QPixmap getCurrentImagePixmap() const {
+        if (m_currentIndex < 0 || m_currentIndex >= m_loadedImages.size()) {
+            return {};
+        }
+        return m_loadedImages[m_currentIndex]->getPixmap();
+    }
+
     // Should always be called in the main thread
     [[nodiscard]] qsizetype getLoadedImagesCount() {
         return m_loadedImages.size();
@@ -155,32 +276,121 @@ class ImagesCarousel : public QWidget {
     void unfocusCurrImage();
     void onStop();
 
+    // Modified images are decoded again, the others are left untouched
+    void applyLibraryChanges(const QStringList& added, const QStringList& removed, const QStringList& modified);
+
   private slots:
     void _onScrollBarValueChanged(int value);
     void _onItemClicked(int index);
     void _onInitImagesLoaded();
 
+  private:
+    // Ordered index of m_loadedImages
+    [[nodiscard]] bool _itemOrderedBefore(const ImageItem* a, const ImageItem* b) const;
+    [[nodiscard]] qsizetype _indexOf(const ImageItem* item) const;
+
+    // Virtual layout of the strip, in content coordinates
+    [[nodiscard]] int _itemOffset(int index) const;
+    [[nodiscard]] int _contentWidth() const;
+    [[nodiscard]] int _firstVisibleIndex(int contentX) const;
+    [[nodiscard]] int _indexAt(const QPoint& contentPos, int viewportHeight) const;
+    void _updateResized(ImageItem* item);
+    void _paintItems(QPainter& painter, const QRect& contentRect);
+    void _updateScrollRange();
+    void _updateLoadFocus(int scrollValue);
+
+    // One timer drives all animations, only the painted layout changes per frame
+    void _animateItem(ImageItem* item, double targetScale);
+    void _animateScroll(int targetValue);
+    void _stopScrollAnimation();
+    void _onAnimationFrame();
+
+    // Thumbnail memory budget
+    void _touchResident(ImageItem* item);
+    void _addResident(ImageItem* item);
+    void _removeResident(ImageItem* item);
+    void _evictResidents();
+    void _replacePixmap(ImageItem* item, const QPixmap& pixmap, bool focusTier);
+
+    // Base size thumbnails for everything, focus size only around the focused item
+    void _updateFocusTier();
+    void _ensureThumbnail(ImageItem* item, quint64 generation = 0);
+    void _requestThumbnail(ImageItem* item, bool focusTier, quint64 generation);
+    void _onThumbnailLoaded(const QString& path, const QImage& image, bool focusTier);
+    void _onThumbnailCancelled(const QString& path);
+
+    // Direction and speed of keyboard or wheel navigation, for prefetching
+    void _recordNavigation(int direction);
+    [[nodiscard]] int _prefetchCount() const;
+
   public:
     void appendImages(const QStringList& paths);
 
   private:
-    Q_INVOKABLE void _insertImage(const ImageData* item);
+    void _startLoaders(const QStringList& paths);
+    void _insertImage(ImageData* data);
+    void _completePlaceholder(ImageItem* item, ImageData* data);
+    void _removeImage(ImageItem* item);
+    bool _skipStopped();                                       // thread-safe
+    void _addLoaded(int count);                                // thread-safe
+    void _decodeFetched(FetchedImage& fetched, int budgetKb);  // thread-safe
+    void _enqueueLoaded(ImageData* data);                      // thread-safe
+    Q_INVOKABLE void _drainLoaded();
 
   private:
     // UI elements
     Ui::ImagesCarousel* ui;
-    QHBoxLayout* m_imagesLayout            = nullptr;
     ImagesCarouselScrollArea* m_scrollArea = nullptr;
 
     // Items and counters
-    QVector<ImageItem*> m_loadedImages;  // m_loadedImages.size() may != m_loadedImagesCount
-    int m_loadedImagesCount = 0;         // increase when _insertImage is called OR ImageLoader::run() is called with m_stopSign as true
-    int m_addedImagesCount  = 0;         // increase when appendImages called
+    QVector<ImageItem*> m_loadedImages;  // sorted, m_loadedImages.size() may != m_loadedImagesCount
+    QVector<ImageItem*> m_resizedItems;  // items whose size currently differs from the base size
+    quint64 m_insertedCount = 0;         // source of ImageItem::m_sequence
+    int m_loadedImagesCount = 0;         // increase when a batch is drained OR a load is skipped (stopped, or its path was already pending)
+    int m_addedImagesCount  = 0;         // increase when loaders are started
     QMutex m_countMutex;                 // for m_loadedImagesCount and m_addedImagesCount
     int m_currentIndex = 0;
+    bool m_hasFocus    = false;  // whether the item at m_currentIndex is focused
+
+    // Which image to load next
+    ImageLoadScheduler m_loadScheduler;
+
+    // Loading pipeline: file contents are read ahead by m_ioPool and decoded by m_decodePool,
+    // m_fetchBudget bounds what is read but not yet decoded
+    QThreadPool m_ioPool;
+    QThreadPool m_decodePool;
+    QSemaphore m_fetchBudget{s_fetchBudgetMb * 1024};  // KiB
+    FileContents::Mode m_fetchMode = FileContents::Read;
+
+    // Finished loads waiting to be integrated on the main thread
+    QQueue<ImageData*> m_loadedQueue;
+    QMutex m_loadedQueueMutex;  // for m_loadedQueue and m_drainScheduled
+    bool m_drainScheduled = false;
+
+    // Items holding pixel data, most recently painted first
+    std::list<ImageItem*> m_residentItems;
+    QHash<QString, ImageItem*> m_itemsByPath;  // for results of asynchronous reloads
+    qint64 m_residentBytes = 0;
+    qint64 m_memoryBudget  = 0;  // bytes, 0 for unlimited
+    quint64 m_paintSerial  = 0;  // increased on every paint of the viewport
+    QVector<ImageItem*> m_focusTierItems;  // items with m_wantsFocusTier set
+
+    // Prefetching in the direction of navigation
+    const int m_prefetchCount;
+    int m_navigationDirection   = 0;    // -1, 0 or 1
+    double m_navigationVelocity = 0.0;  // items per second, smoothed
+    QElapsedTimer m_navigationClock;
+    std::atomic<quint64> m_prefetchGeneration{1};  // jobs of older generations are cancelled
 
     // Animations
-    QPropertyAnimation* m_scrollAnimation = nullptr;
+    QTimer* m_animationTimer = nullptr;
+    QElapsedTimer m_animationClock;
+    QEasingCurve m_easing{QEasingCurve::OutCubic};
+    QVector<ImageItem*> m_animatingItems;
+    bool m_scrollAnimating = false;
+    int m_scrollFrom       = 0;
+    int m_scrollTo         = 0;
+    qint64 m_scrollStart   = 0;  // ms on the animation clock
 
     // Auto focusing
     bool m_suppressAutoFocus      = false;
@@ -201,16 +411,23 @@ class ImagesCarousel : public QWidget {
     void stopped();
 };
 
-class ImagesCarouselScrollArea : public QScrollArea {
+/**
+ * @brief Viewport of the carousel. Paints only the items intersecting
+ *        the visible scroll range instead of holding one widget per image.
+ */
+class ImagesCarouselScrollArea : public QAbstractScrollArea {
     Q_OBJECT
 
   public:
     explicit ImagesCarouselScrollArea(QWidget* parent = nullptr)
-        : QScrollArea(parent) {
+        : QAbstractScrollArea(parent) {
         // setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-        // setWidgetResizable(true);
+        // same background as the surrounding window, like QScrollArea
+        viewport()->setBackgroundRole(QPalette::NoRole);
     }
 
+    void setCarousel(ImagesCarousel* carousel) { m_carousel = carousel; }
+
     void setBlockInput(bool block) { m_blockInput = block; }
 
   protected:
@@ -222,7 +439,7 @@ class ImagesCarouselScrollArea : public QScrollArea {
         if (event->key() == Qt::Key_Left || event->key() == Qt::Key_Right) {
             event->ignore();
         } else {
-            QScrollArea::keyPressEvent(event);
+            QAbstractScrollArea::keyPressEvent(event);
         }
     }
 
@@ -234,12 +451,21 @@ class ImagesCarouselScrollArea : public QScrollArea {
         if (event->angleDelta().y() != 0) {
             event->ignore();
         } else {
-            QScrollArea::wheelEvent(event);
+            QAbstractScrollArea::wheelEvent(event);
         }
     }
 
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
   private:
-    bool m_blockInput = false;
+    ImagesCarousel* m_carousel = nullptr;
+    bool m_blockInput          = false;
+
+  signals:
+    void itemClicked(int index);
 };
 
 #endif  // IMAGES_CAROUSEL_H
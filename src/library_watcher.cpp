@@ -0,0 +1,300 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-21 14:03:26
+ * @LastEditTime: 2026-10-27 10:48:17
+ * @Description: Implementation of the library watcher.
+ */
+#include "library_watcher.h"
+
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <QFile>
+#include <QMetaObject>
+#include <utility>
+
+#include "logger.h"
+#include "rejected_image_cache.h"
+#include "wallpaper_scanner.h"
+using namespace GeneralLogger;
+
+// new files are picked up once fully written, IN_CREATE only matters for directories
+static constexpr quint32 s_watchMask =
+    IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR;
+
+static QString normalizedDir(QString dir) {
+    while (dir.size() > 1 && dir.endsWith('/')) {
+        dir.chop(1);
+    }
+    return dir;
+}
+
+static QString parentDir(const QString& path) {
+    const auto pos = path.lastIndexOf('/');
+    return pos > 0 ? path.left(pos) : QString("/");
+}
+
+LibraryWatcher::LibraryWatcher(const Config::WallpaperConfigItems& config, QObject* parent)
+    : QObject(parent),
+      m_roots(config.dirs),
+      m_excludes(config.excludes.begin(), config.excludes.end()),
+      m_maxDepth(config.recursive ? qMax(0, config.maxDepth) : 0),
+      m_index(new DirectoryIndex(DirectoryIndex::defaultFilePath())) {
+    m_batchPool.setMaxThreadCount(1);
+    m_debounceTimer = new QTimer(this);
+    m_debounceTimer->setSingleShot(true);
+    connect(m_debounceTimer, &QTimer::timeout, this, &LibraryWatcher::_processBatch);
+
+    m_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        warn(QString("Failed to initialize inotify: %1").arg(::strerror(errno)));
+        return;
+    }
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, [this]() {
+        _onInotifyReadable();
+    });
+}
+
+LibraryWatcher::~LibraryWatcher() {
+    m_batchPool.clear();
+    m_batchPool.waitForDone();
+    delete m_notifier;
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+void LibraryWatcher::start(const QStringList& knownPaths) {
+    if (m_fd < 0) {
+        return;
+    }
+    m_known = QSet<QString>(knownPaths.begin(), knownPaths.end());
+
+    // the first batch sets up the watches, mostly served from the directory index
+    for (const auto& root : m_roots) {
+        m_pending.dirs.insert(root, 0);
+    }
+    m_pending.loadIndex = true;
+    _processBatch();
+}
+
+void LibraryWatcher::_onInotifyReadable() {
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        const auto length = ::read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;  // EAGAIN once drained
+        }
+        for (const char* ptr = buffer; ptr < buffer + length;) {
+            const auto event = reinterpret_cast<const inotify_event*>(ptr);
+            _handleEvent(*event);
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+    _schedule();
+}
+
+void LibraryWatcher::_handleEvent(const inotify_event& event) {
+    if (event.mask & IN_Q_OVERFLOW) {
+        // events were lost, compare everything against the directories again
+        warn("Inotify event queue overflowed, rescanning wallpaper directories");
+        for (const auto& root : m_roots) {
+            m_pending.dirs.insert(root, 0);
+        }
+        return;
+    }
+    const auto it = m_watches.constFind(event.wd);
+    if (it == m_watches.cend()) {
+        return;
+    }
+    const QString dir = it.value();
+    if (event.mask & IN_IGNORED) {
+        // watch removed by the kernel, e.g. the directory itself was deleted
+        m_watches.erase(it);
+        m_watchDepths.remove(dir);
+        return;
+    }
+    if (event.len == 0) {
+        return;
+    }
+    const QString path = dir + '/' + QFile::decodeName(event.name);
+
+    if (event.mask & IN_ISDIR) {
+        if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+            const int depth = m_watchDepths.value(dir) + 1;
+            if (depth <= m_maxDepth) {
+                m_pending.dirs.insert(path, depth);
+            }
+        } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+            m_removedDirs.insert(path);
+        }
+        return;
+    }
+    if ((event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)) &&
+        Config::hasValidExtension(path)) {
+        m_pending.files.insert(path);
+    }
+}
+
+void LibraryWatcher::_schedule() {
+    if (m_pending.files.isEmpty() && m_pending.dirs.isEmpty() && m_removedDirs.isEmpty()) {
+        return;
+    }
+    if (!m_pendingSince.isValid()) {
+        m_pendingSince.start();
+    }
+    // wait for the burst to end, but not forever
+    const qint64 remaining = s_maxDelay - m_pendingSince.elapsed();
+    m_debounceTimer->start(static_cast<int>(qBound<qint64>(0, remaining, s_debounceInterval)));
+}
+
+void LibraryWatcher::_processBatch() {
+    if (m_processing) {
+        return;  // rescheduled when the running batch finishes
+    }
+    m_pendingSince.invalidate();
+
+    // files below removed directories are gone without further checks
+    for (const auto& dir : std::exchange(m_removedDirs, {})) {
+        const QString prefix = dir + '/';
+        for (auto it = m_known.begin(); it != m_known.end();) {
+            if (it->startsWith(prefix)) {
+                m_removedInBatch.append(*it);
+                it = m_known.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        _unwatch(dir);
+    }
+
+    m_processing       = true;
+    const Batch batch  = std::exchange(m_pending, {});
+    const int maxDepth = m_maxDepth;
+    const auto index   = m_index;
+    // the destructor waits for the batch, so this outlives it
+    m_batchPool.start([this, batch, maxDepth, index]() {
+        const auto result = _runBatch(batch, maxDepth, index.data());
+        QMetaObject::invokeMethod(
+            this,
+            [this, result]() {
+                _onBatchProcessed(result);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
+LibraryWatcher::BatchResult LibraryWatcher::_runBatch(const Batch& batch, int maxDepth, DirectoryIndex* index) {
+    BatchResult result;
+    if (batch.loadIndex) {
+        index->load();
+    }
+
+    // deleted files are simply not valid, no need to warn about each of them
+    result.checkedFiles = batch.files;
+    for (const auto& file : batch.files) {
+        if (QFileInfo::exists(file) && Config::isValidImageFile(file)) {
+            result.validFiles.insert(file);
+        }
+    }
+
+    for (auto it = batch.dirs.cbegin(); it != batch.dirs.cend(); ++it) {
+        WallpaperScanner scanner(maxDepth - it.value(), index);
+        for (const auto& file : scanner.scan({it.key()})) {
+            result.scannedFiles.insert(file);
+        }
+        const auto scannedDirs = scanner.getScannedDirs();
+        for (auto dirIt = scannedDirs.cbegin(); dirIt != scannedDirs.cend(); ++dirIt) {
+            result.scannedDirs.insert(normalizedDir(dirIt.key()), it.value() + dirIt.value());
+        }
+    }
+
+    index->save();
+    RejectedImageCache::instance()->save();
+    return result;
+}
+
+void LibraryWatcher::_onBatchProcessed(const BatchResult& result) {
+    m_processing = false;
+
+    QStringList added, modified;
+    QStringList removed = std::exchange(m_removedInBatch, {});
+    for (const auto& file : result.checkedFiles) {
+        if (_isExcluded(file)) {
+            continue;
+        }
+        const bool valid = result.validFiles.contains(file);
+        if (m_known.contains(file)) {
+            if (valid) {
+                modified.append(file);
+            } else {
+                removed.append(file);
+                m_known.remove(file);
+            }
+        } else if (valid) {
+            added.append(file);
+            m_known.insert(file);
+        }
+    }
+    for (const auto& file : result.scannedFiles) {
+        if (!_isExcluded(file) && !m_known.contains(file) && !result.checkedFiles.contains(file)) {
+            added.append(file);
+            m_known.insert(file);
+        }
+    }
+    if (!result.scannedDirs.isEmpty()) {
+        // known files directly in a scanned directory which were not found there
+        for (auto it = m_known.begin(); it != m_known.end();) {
+            if (result.scannedDirs.contains(parentDir(*it)) && !result.scannedFiles.contains(*it) &&
+                !result.checkedFiles.contains(*it)) {
+                removed.append(*it);
+                it = m_known.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    for (auto it = result.scannedDirs.cbegin(); it != result.scannedDirs.cend(); ++it) {
+        if (!m_watchDepths.contains(it.key())) {
+            _watch(it.key(), it.value());
+        }
+    }
+
+    if (!added.isEmpty() || !removed.isEmpty() || !modified.isEmpty()) {
+        info(QString("Library changed: %1 added, %2 removed, %3 modified")
+                 .arg(added.size())
+                 .arg(removed.size())
+                 .arg(modified.size()));
+        emit libraryChanged(added, removed, modified);
+    }
+
+    // events which arrived in the meantime
+    _schedule();
+}
+
+void LibraryWatcher::_watch(const QString& dir, int depth) {
+    const int wd = ::inotify_add_watch(m_fd, QFile::encodeName(dir).constData(), s_watchMask);
+    if (wd < 0) {
+        LOG_WARN(QString("Failed to watch directory %1: %2").arg(dir, ::strerror(errno)), GeneralLogger::DETAIL);
+        return;
+    }
+    m_watches.insert(wd, dir);
+    m_watchDepths.insert(dir, depth);
+}
+
+void LibraryWatcher::_unwatch(const QString& dir) {
+    const QString prefix = dir + '/';
+    for (auto it = m_watches.begin(); it != m_watches.end();) {
+        if (it.value() == dir || it.value().startsWith(prefix)) {
+            // already gone if the directory was deleted rather than moved away
+            ::inotify_rm_watch(m_fd, it.key());
+            m_watchDepths.remove(it.value());
+            it = m_watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
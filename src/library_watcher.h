@@ -0,0 +1,96 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-21 14:03:26
+ * @LastEditTime: 2026-10-27 10:48:17
+ * @Description: Watches wallpaper directories for changes.
+ */
+#ifndef LIBRARY_WATCHER_H
+#define LIBRARY_WATCHER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QSharedPointer>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+#include "config.h"
+#include "directory_index.h"
+
+struct inotify_event;
+
+/**
+ * @brief Watches wallpaper.dirs, and their subdirectories if recursive, with inotify
+ *        and reports added, removed and modified wallpapers in debounced batches.
+ *        Events name the changed file, so only that file is checked again.
+ *        New directories and overflows of the event queue fall back to scanning.
+ */
+class LibraryWatcher : public QObject {
+    Q_OBJECT
+
+  public:
+    explicit LibraryWatcher(const Config::WallpaperConfigItems& config, QObject* parent = nullptr);
+    ~LibraryWatcher();
+
+    // Changes since knownPaths were collected are reported by the first batch
+    void start(const QStringList& knownPaths);
+
+    static constexpr int s_debounceInterval = 500;   // ms without events before a batch is processed
+    static constexpr int s_maxDelay         = 3000;  // ms, upper bound while events keep coming
+
+  private:
+    struct Batch {
+        QSet<QString> files;       // to be checked again
+        QHash<QString, int> dirs;  // to be scanned, with their depth
+        bool loadIndex = false;
+    };
+
+    struct BatchResult {
+        QSet<QString> checkedFiles;
+        QSet<QString> validFiles;         // of checkedFiles
+        QSet<QString> scannedFiles;       // found in scanned directories
+        QHash<QString, int> scannedDirs;  // including subdirectories, with their depth
+    };
+
+    static BatchResult _runBatch(const Batch& batch, int maxDepth, DirectoryIndex* index);
+
+    void _onInotifyReadable();
+    void _handleEvent(const inotify_event& event);
+    void _schedule();
+    void _processBatch();
+    void _onBatchProcessed(const BatchResult& result);
+    void _watch(const QString& dir, int depth);
+    void _unwatch(const QString& dir);
+    [[nodiscard]] bool _isExcluded(const QString& path) const { return m_excludes.contains(path); }
+
+  private:
+    const QStringList m_roots;
+    const QSet<QString> m_excludes;
+    const int m_maxDepth;
+
+    int m_fd                    = -1;
+    QSocketNotifier* m_notifier = nullptr;
+    QHash<int, QString> m_watches;      // watch descriptor -> directory
+    QHash<QString, int> m_watchDepths;  // directory -> depth below its root
+
+    QSet<QString> m_known;  // paths currently reported as wallpapers
+    QSharedPointer<DirectoryIndex> m_index;
+
+    // Collected events
+    Batch m_pending;
+    QSet<QString> m_removedDirs;
+    QStringList m_removedInBatch;  // files of removed directories, reported with the running batch
+    QElapsedTimer m_pendingSince;
+    QTimer* m_debounceTimer = nullptr;
+    bool m_processing       = false;  // only one batch at a time
+
+    QThreadPool m_batchPool;  // runs the batches, waited for when destroyed
+
+  signals:
+    void libraryChanged(const QStringList& added, const QStringList& removed, const QStringList& modified);
+};
+
+#endif  // LIBRARY_WATCHER_H
@@ -1,7 +1,7 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-07 01:12:37
- * @LastEditTime: 2025-08-07 22:24:27
+ * @LastEditTime: 2026-10-26 17:58:12
  * @Description: Implementation of logger.
  */
 #include "logger.h"
@@ -12,24 +12,59 @@
 
 #include <unistd.h>
 
-#include <QCoreApplication>
-#include <QObject>
-#include <QProcessEnvironment>
+#include <QByteArray>
 #include <QString>
-#include <QTextStream>
-#include <QThreadPool>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+static constexpr qsizetype s_batchSize = 64 * 1024;  // bytes written at once
+
+static bool resolveColored(FILE* stream) {
+    if (!isatty(fileno(stream))) {
+        return false;
+    }
+    const auto term = qgetenv("TERM");
+    return !term.isEmpty() && term != "dumb";
+}
+
+static void formatRecord(QByteArray& line,
+                         Logger::Level level,
+                         const QString& msg,
+                         GeneralLogger::LogIndent indent,
+                         bool colored) {
+    static constexpr const char* levelStrings[]{"[INFO]", "[WARN]", "[ERROR]"};
+    static constexpr const char* levelColors[]{"\033[92m", "\033[93m", "\033[91m"};
+    static constexpr const char* infoTextColors[]{"\033[32m", "\033[0m", "\033[0m"};
+    static constexpr const char* textColors[]{nullptr, "\033[33m", "\033[31m"};
+
+    if (colored) {
+        line.append(levelColors[level]);
+    }
+    line.append(levelStrings[level]).append(' ');
+    for (qint32 i = 0; i < indent; i++) line.append("  ");
+    if (colored) {
+        line.append(level == Logger::Info ? infoTextColors[indent] : textColors[level]);
+    }
+    line.append(msg.toUtf8());
+    line.append(colored ? "\033[0m\n" : "\n");
+}
 
 Logger* Logger::instance(FILE* stream,
                          GeneralLogger::LogIndent indent,
                          QObject* parent) {
-    static Logger* logger{};
+    static std::mutex creationMutex;
+    auto logger = s_instance.load(std::memory_order_acquire);
     if (!logger) {
-        if (!stream) {
-            stream = stderr;  // Default to stderr if no stream provided
+        std::lock_guard<std::mutex> locker(creationMutex);
+        logger = s_instance.load(std::memory_order_acquire);
+        if (!logger && !s_destroyed.load(std::memory_order_acquire)) {
+            if (!stream) {
+                stream = stderr;  // Default to stderr if no stream provided
+            }
+            logger = new Logger(stream, indent, parent);
+            s_instance.store(logger, std::memory_order_release);
         }
-        logger = new Logger(stream, indent, parent);
-        // Ensure logger runs in the main thread
-        logger->moveToThread(QCoreApplication::instance()->thread());
     }
     return logger;
 }
@@ -37,54 +72,213 @@ Logger* Logger::instance(FILE* stream,
 Logger::Logger(FILE* stream,
                GeneralLogger::LogIndent indent,
                QObject* parent)
-    : QObject(parent), m_stream(stream), m_logStream(stream), m_indent(indent) {
-    connect(this,
-            &Logger::logSig,
-            this,
-            &Logger::_log,
-            Qt::AutoConnection);
+    : QObject(parent),
+      m_stream(stream),
+      m_indent(indent),
+      m_colored(resolveColored(stream)),
+      m_ring(new Slot[s_ringSize]) {
+    for (qsizetype i = 0; i < s_ringSize; i++) {
+        m_ring[i].sequence.store(static_cast<size_t>(i), std::memory_order_relaxed);
+    }
+    m_writer = std::thread([this]() { _writerLoop(); });
 }
 
-void Logger::_log(
-    const QString& msg,
-    const QString& levelString,
-    const QString& levelColorString,
-    const QString& textColorString,
-    const GeneralLogger::LogIndent indent) {
-
-    if (indent > m_indent) return;
-    m_logStream << levelColorString << levelString << ' ';
-    for (qint32 i = 0; i < indent; i++) m_logStream << "  ";
-    m_logStream << textColorString << msg << (textColorString.isEmpty() ? "\n" : "\033[0m\n");
-    m_logStream.flush();
+Logger::~Logger() {
+    // records from now on are written synchronously, and no logger is created in its place
+    s_destroyed.store(true, std::memory_order_seq_cst);
+    s_instance.store(nullptr, std::memory_order_release);
+    // calls which got hold of this logger before may still be enqueuing
+    while (s_users.load(std::memory_order_seq_cst) > 0) {
+        std::this_thread::yield();
+    }
+    {
+        std::lock_guard<std::mutex> locker(m_wakeMutex);
+        m_stopping = true;
+    }
+    m_wakeCondition.notify_one();
+    m_writer.join();
+    delete[] m_ring;
 }
 
+namespace {
+// keeps the destructor of the logger waiting until the call is done with it
+class LoggerUse {
+  public:
+    LoggerUse(std::atomic<int>& users, const std::atomic<bool>& destroyed)
+        : m_users(users) {
+        m_users.fetch_add(1, std::memory_order_seq_cst);
+        // may still be cleared by a destructor that started meanwhile
+        m_logger = destroyed.load(std::memory_order_seq_cst) ? nullptr : Logger::instance();
+    }
+
+    ~LoggerUse() { m_users.fetch_sub(1, std::memory_order_release); }
+
+    // nullptr once the logger is gone
+    [[nodiscard]] Logger* logger() const { return m_logger; }
+
+  private:
+    std::atomic<int>& m_users;
+    Logger* m_logger;
+};
+}  // namespace
+
 bool Logger::isColored() {
-    const auto stream = Logger::instance()->m_stream;
-    if (!isatty(fileno(stream))) {
+    LoggerUse use(s_users, s_destroyed);
+    return use.logger() && use.logger()->m_colored;
+}
+
+bool Logger::isEnabled(GeneralLogger::LogIndent indent) {
+    if (indent > GENERAL_LOGGER_MAX_INDENT) {
         return false;
     }
-    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-    QString term            = env.value("TERM");
-    if (term.isEmpty() || term == "dumb") {
-        return false;
+    LoggerUse use(s_users, s_destroyed);
+    // written synchronously and unfiltered once the logger is gone
+    return !use.logger() || indent <= use.logger()->m_indent;
+}
+
+void Logger::log(Level level, const QString& msg, GeneralLogger::LogIndent indent) {
+    if (indent > GENERAL_LOGGER_MAX_INDENT) {
+        return;
     }
-    return true;
+
+    // preallocated once per thread, records are copied out of it into the ring
+    thread_local QByteArray line;
+    if (line.capacity() < s_slotSize) {
+        line.reserve(s_slotSize);
+    }
+    line.resize(0);
+
+    LoggerUse use(s_users, s_destroyed);
+    const auto logger = use.logger();
+    if (!logger) {
+        // e.g. from destructors of static objects during shutdown
+        formatRecord(line, level, msg, indent, false);
+        std::fwrite(line.constData(), 1, static_cast<size_t>(line.size()), stderr);
+        return;
+    }
+
+    if (indent > logger->m_indent) {
+        return;
+    }
+    formatRecord(line, level, msg, indent, logger->m_colored);
+    logger->_enqueue(line.constData(), line.size(), level == Error);
+}
+
+void Logger::_enqueue(const char* data, qsizetype length, bool flush) {
+    // claim a slot, see D. Vyukov's bounded MPMC queue
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+        slot            = &m_ring[pos & (s_ringSize - 1)];
+        const auto seq  = slot->sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<qint64>(seq) - static_cast<qint64>(pos);
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // full, let the writer catch up
+            _wakeWriter();
+            std::this_thread::yield();
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    if (length > s_slotSize) {
+        static constexpr char truncated[] = " ...\n";
+        length                             = s_slotSize;
+        std::memcpy(slot->data, data, static_cast<size_t>(length));
+        std::memcpy(slot->data + length - (sizeof(truncated) - 1), truncated, sizeof(truncated) - 1);
+    } else {
+        std::memcpy(slot->data, data, static_cast<size_t>(length));
+    }
+    slot->length = length;
+    slot->flush  = flush;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // only bother the writer if it is about to sleep, or if this must be out at once
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (flush || m_writerSleeping.load(std::memory_order_relaxed)) {
+        _wakeWriter();
+    }
+}
+
+void Logger::_wakeWriter() {
+    // taking the mutex makes sure the writer is either before its last check or already waiting
+    {
+        std::lock_guard<std::mutex> locker(m_wakeMutex);
+    }
+    m_wakeCondition.notify_one();
+}
+
+bool Logger::_drain(QByteArray& batch, bool& flush) {
+    bool drained = false;
+    while (batch.size() < s_batchSize) {
+        Slot& slot = m_ring[m_dequeuePos & (s_ringSize - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1) {
+            break;
+        }
+        batch.append(slot.data, slot.length);
+        flush = flush || slot.flush;
+        // hand the slot back to the producers of the next round
+        slot.sequence.store(m_dequeuePos + s_ringSize, std::memory_order_release);
+        m_dequeuePos++;
+        drained = true;
+    }
+    return drained;
+}
+
+void Logger::_writerLoop() {
+    QByteArray batch;
+    batch.reserve(s_batchSize + s_slotSize);
+    for (;;) {
+        bool flush         = false;
+        const bool drained = _drain(batch, flush);
+        if (!batch.isEmpty()) {
+            std::fwrite(batch.constData(), 1, static_cast<size_t>(batch.size()), m_stream);
+            batch.resize(0);
+        }
+        if (flush) {
+            std::fflush(m_stream);
+        }
+        if (drained) {
+            continue;
+        }
+        if (m_stopping) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> locker(m_wakeMutex);
+        m_writerSleeping = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // a record may have been published before the flag was visible to its producer
+        const Slot& next = m_ring[m_dequeuePos & (s_ringSize - 1)];
+        if (!m_stopping && next.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1) {
+            m_wakeCondition.wait_for(locker, std::chrono::milliseconds(s_writerIdle));
+        }
+        m_writerSleeping = false;
+    }
+    std::fflush(m_stream);
 }
 
 #endif  // GENERAL_LOGGER_DISABLED
 
+bool GeneralLogger::isEnabled(const GeneralLogger::LogIndent indent) {
+#ifndef GENERAL_LOGGER_DISABLED
+    return Logger::isEnabled(indent);
+#else
+    Q_UNUSED(indent);
+    return false;
+#endif  // GENERAL_LOGGER_DISABLED
+}
+
 void GeneralLogger::info(
     const QString& msg,
     const GeneralLogger::LogIndent indent) {
 #ifndef GENERAL_LOGGER_DISABLED
-    constexpr const char* colorInfoMsg[]{"\033[32m", "\033[0m", "\033[0m"};
-    const auto color = Logger::isColored();
-    emit Logger::instance() -> logSig(msg,
-                                      "[INFO]",
-                                      color ? "\033[92m" : "",
-                                      color ? colorInfoMsg[indent] : "",
-                                      indent);
+    Logger::log(Logger::Info, msg, indent);
 #endif  // GENERAL_LOGGER_DISABLED
 }
 
@@ -92,12 +286,7 @@ void GeneralLogger::warn(
     const QString& msg,
     const GeneralLogger::LogIndent indent) {
 #ifndef GENERAL_LOGGER_DISABLED
-    const auto color = Logger::isColored();
-    emit Logger::instance() -> logSig(msg,
-                                      "[WARN]",
-                                      color ? "\033[93m" : "",
-                                      color ? "\033[33m" : "",
-                                      indent);
+    Logger::log(Logger::Warn, msg, indent);
 #endif  // GENERAL_LOGGER_DISABLED
 }
 
@@ -105,11 +294,6 @@ void GeneralLogger::error(
     const QString& msg,
     const GeneralLogger::LogIndent indent) {
 #ifndef GENERAL_LOGGER_DISABLED
-    const auto color = Logger::isColored();
-    emit Logger::instance() -> logSig(msg,
-                                      "[ERROR]",
-                                      color ? "\033[91m" : "",
-                                      color ? "\033[31m" : "",
-                                      indent);
+    Logger::log(Logger::Error, msg, indent);
 #endif  // GENERAL_LOGGER_DISABLED
-}
\ No newline at end of file
+}
@@ -1,15 +1,19 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-05 10:43:31
- * @LastEditTime: 2025-08-07 21:26:09
+ * @LastEditTime: 2026-10-26 17:58:12
  * @Description: A simple thread-safe logger for general use.
  */
 #ifndef GENERAL_LOGGER_H
 #define GENERAL_LOGGER_H
 
+#include <QByteArray>
 #include <QObject>
 #include <QString>
-#include <QTextStream>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 namespace GeneralLogger {
 
@@ -27,42 +31,111 @@ void warn(const QString& msg,
 
 void error(const QString& msg,
            const LogIndent indent = GENERAL);
+
+// Whether records of this indent are written at all
+bool isEnabled(const LogIndent indent);
 }  // namespace GeneralLogger
 
+// Most detailed indent compiled in, set through the GENERAL_LOGGER_LEVEL CMake option
+#ifndef GENERAL_LOGGER_MAX_INDENT
+#define GENERAL_LOGGER_MAX_INDENT 2
+#endif  // GENERAL_LOGGER_MAX_INDENT
+
+/**
+ * LOG_INFO(msg), LOG_INFO(msg, indent) and the like. Unlike the plain functions,
+ * msg is only evaluated if the record is going to be written, and calls more detailed
+ * than GENERAL_LOGGER_MAX_INDENT compile to nothing. indent must be a constant.
+ */
 #ifndef GENERAL_LOGGER_DISABLED
+#define GENERAL_LOGGER_CALL(fn, msg, indent, ...)                              \
+    do {                                                                       \
+        if constexpr ((indent) <= GENERAL_LOGGER_MAX_INDENT) {                 \
+            if (GeneralLogger::isEnabled(indent)) {                            \
+                fn(msg, indent);                                               \
+            }                                                                  \
+        }                                                                      \
+    } while (0)
+#else
+#define GENERAL_LOGGER_CALL(fn, msg, indent, ...) \
+    do {                                          \
+    } while (0)
+#endif  // GENERAL_LOGGER_DISABLED
+
+#define LOG_INFO(...)  GENERAL_LOGGER_CALL(GeneralLogger::info, __VA_ARGS__, GeneralLogger::GENERAL, 0)
+#define LOG_WARN(...)  GENERAL_LOGGER_CALL(GeneralLogger::warn, __VA_ARGS__, GeneralLogger::GENERAL, 0)
+#define LOG_ERROR(...) GENERAL_LOGGER_CALL(GeneralLogger::error, __VA_ARGS__, GeneralLogger::GENERAL, 0)
+
+#ifndef GENERAL_LOGGER_DISABLED
+
+/**
+ * @brief Formats records on the calling thread and hands them over to a writer thread
+ *        through a lock-free ring, so that logging never waits for the stream.
+ *        The stream is only flushed after errors and when the logger is destroyed.
+ */
 class Logger : public QObject {
     Q_OBJECT
 
   public:
+    enum Level : qint32 {
+        Info = 0,
+        Warn,
+        Error,
+    };
+
+    // nullptr once the logger has been destroyed, records are then written synchronously
     static Logger* instance(FILE* stream                    = nullptr,
                             GeneralLogger::LogIndent indent = GeneralLogger::DETAIL,
                             QObject* parent                 = nullptr);
 
+    ~Logger();
+
+    // Resolved once when the logger is created
     static bool isColored();
 
+    static void log(Level level, const QString& msg, GeneralLogger::LogIndent indent);
+
+    static bool isEnabled(GeneralLogger::LogIndent indent);
+
   private:
     explicit Logger(FILE* stream,
                     GeneralLogger::LogIndent indent,
                     QObject* parent);
 
-  private slots:
-    void _log(const QString& msg,
-              const QString& levelString,
-              const QString& levelColorString,
-              const QString& textColorString,
-              const GeneralLogger::LogIndent indent);
+    void _enqueue(const char* data, qsizetype length, bool flush);
+    void _wakeWriter();
+    void _writerLoop();
+    bool _drain(QByteArray& batch, bool& flush);
 
   private:
+    static constexpr qsizetype s_ringSize = 1024;  // records, power of two
+    static constexpr qsizetype s_slotSize = 1000;  // bytes per record, longer ones are truncated
+    static constexpr int s_writerIdle     = 100;   // ms between checks when nothing was signaled
+
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        qsizetype length = 0;
+        bool flush       = false;
+        char data[s_slotSize];
+    };
+
+    static inline std::atomic<Logger*> s_instance{nullptr};
+    static inline std::atomic<bool> s_destroyed{false};  // never created again afterwards
+    static inline std::atomic<int> s_users{0};           // calls currently holding the instance
+
     FILE* m_stream;
-    QTextStream m_logStream;
-    GeneralLogger::LogIndent m_indent;
-
-  signals:
-    void logSig(const QString& msg,
-                const QString& levelString,
-                const QString& levelColorString,
-                const QString& textColorString,
-                const GeneralLogger::LogIndent indent);
+    const GeneralLogger::LogIndent m_indent;
+    const bool m_colored;
+
+    // bounded multi-producer single-consumer ring, slot sequences tell whose turn it is
+    Slot* m_ring;
+    alignas(64) std::atomic<size_t> m_enqueuePos{0};
+    alignas(64) size_t m_dequeuePos = 0;  // writer thread only
+
+    std::atomic<bool> m_writerSleeping{false};
+    std::atomic<bool> m_stopping{false};
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+    std::thread m_writer;
 };
 
 #endif  // GENERAL_LOGGER_DISABLED
@@ -1,7 +1,7 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-05 00:37:58
- * @LastEditTime: 2025-08-07 22:21:29
+ * @LastEditTime: 2026-10-26 13:27:45
  * @Description: Entry point.
  */
 #include <qapplication.h>
@@ -10,10 +10,14 @@
 #include <QDir>
 #include <QStandardPaths>
 #include <QTextStream>
+#include <cstring>
 
 #include "config.h"
+#include "daemon_server.h"
 #include "logger.h"
 #include "main_window.h"
+#include "rejected_image_cache.h"
+#include "trace.h"
 
 static QString getConfigDir() {
     auto configDir = QStandardPaths::writableLocation(QStandardPaths::AppConfigLocation);
@@ -24,17 +28,64 @@ static QString getConfigDir() {
     return configDir;
 }
 
+static bool hasArgument(int argc, char *argv[], const char *name) {
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 int main(int argc, char *argv[]) {
+    const bool daemonMode = hasArgument(argc, argv, "--daemon");
+
+    // a resident instance shows its window instead of a new one being started,
+    // checked before anything else so that this path stays cheap
+    if (DaemonServer::sendCommand(daemonMode ? DaemonServer::s_pingCommand : DaemonServer::s_showCommand)) {
+        return 0;
+    }
+
+    // WALLPAPER_CAROUSEL_TRACE=<file> or --trace (to the cache directory)
+    const auto traceFile = qEnvironmentVariable("WALLPAPER_CAROUSEL_TRACE");
+    if (!traceFile.isEmpty() || hasArgument(argc, argv, "--trace")) {
+        Trace::start(traceFile.isEmpty() ? Trace::defaultFilePath() : traceFile);
+    }
+
     QApplication a(argc, argv);
 
 #ifndef GENERAL_LOGGER_DISABLED
     Logger::instance(stderr, GeneralLogger::LogIndent::DETAIL, &a);
 #endif  // GENERAL_LOGGER_DISABLED
 
+    // the socket is claimed before loading, so that launches in the meantime reach this
+    // instance (their commands wait in the socket's backlog) instead of starting another one
+    DaemonServer server;
+    bool listening = false;
+    if (daemonMode) {
+        if (!server.claim()) {
+            GeneralLogger::info("Another daemon is already starting");
+            return 0;
+        }
+        listening = server.listen();
+    }
+
     Config config(getConfigDir());
 
     MainWindow w(config);
-    w.show();
 
-    return a.exec();
+    if (listening) {
+        // keep running hidden with everything loaded until asked to show up
+        a.setQuitOnLastWindowClosed(false);
+        w.setDaemonMode(true);
+        QObject::connect(&server, &DaemonServer::showRequested, &w, &MainWindow::showAndActivate);
+    } else {
+        w.show();
+    }
+
+    const auto ret = a.exec();
+    // images which failed to decode during this run
+    RejectedImageCache::instance()->save();
+    Trace::write();
+    return ret;
 }
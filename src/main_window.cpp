@@ -1,7 +1,7 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-05 00:37:58
- * @LastEditTime: 2025-10-25 12:04:38
+ * @LastEditTime: 2026-10-25 11:26:40
  * @Description: MainWindow implementation.
  */
 #include "main_window.h"
@@ -14,6 +14,8 @@
 #include "./ui_main_window.h"
 #include "images_carousel.h"
 #include "logger.h"
+#include "rejected_image_cache.h"
+#include "thumbnail_cache.h"
 
 using namespace GeneralLogger;
 
@@ -39,6 +41,7 @@ void MainWindow::_setupUI() {
     m_carousel = new ImagesCarousel(
         m_config.getStyleConfig(),
         m_config.getSortConfig(),
+        m_config.getLoadingConfig(),
         this);
     ui->mainLayout->insertWidget(2, m_carousel);
     connect(m_carousel,
@@ -79,7 +82,22 @@ void MainWindow::_setupUI() {
     ui->confirmButton->setFocusPolicy(Qt::NoFocus);
     ui->cancelButton->setFocusPolicy(Qt::NoFocus);
 
+    // configure thumbnail cache before any loader starts
+    const auto& cacheConfig = m_config.getCacheConfig();
+    ThumbnailCache::instance()->setEnabled(cacheConfig.enabled);
+    ThumbnailCache::instance()->setMaxSize(static_cast<qint64>(cacheConfig.maxSizeMb) * 1024 * 1024);
+
     m_carousel->appendImages(m_config.getWallpapers());
+
+    // apply changes in the wallpaper directories from now on
+    if (m_config.getWallpaperConfig().watch) {
+        m_libraryWatcher = new LibraryWatcher(m_config.getWallpaperConfig(), this);
+        connect(m_libraryWatcher,
+                &LibraryWatcher::libraryChanged,
+                m_carousel,
+                &ImagesCarousel::applyLibraryChanges);
+        m_libraryWatcher->start(m_config.getWallpapers());
+    }
 }
 
 void MainWindow::keyPressEvent(QKeyEvent* event) {
@@ -124,6 +142,9 @@ void MainWindow::keyPressEvent(QKeyEvent* event) {
                 case Qt::Key_Left:
                     m_carousel->focusPrevImage();
                     break;
+                case Qt::Key_Z:
+                    _openPreview();
+                    break;
                 default:
                     QMainWindow::keyPressEvent(event);
             }
@@ -135,6 +156,12 @@ void MainWindow::keyPressEvent(QKeyEvent* event) {
 }
 
 void MainWindow::_onCancelPressed() {
+    // the daemon keeps loading while hidden
+    if (m_daemonMode) {
+        info("Hiding window.");
+        onCancel();
+        return;
+    }
     switch (m_state) {
         case Loading:
             // case loading screen is disabled, quit the app
@@ -175,8 +202,13 @@ void MainWindow::_onCancelPressed() {
 void MainWindow::_onConfirmPressed() {
     switch (m_state) {
         case Loading:
+            // the daemon confirms the selection without stopping the loaders
+            if (m_daemonMode && m_config.getStyleConfig().noLoadingScreen) {
+                info("Confirming selection.");
+                onConfirm();
+            }
             // case loading screen is disabled, confirm the selection
-            if (m_config.getStyleConfig().noLoadingScreen) {
+            else if (m_config.getStyleConfig().noLoadingScreen) {
                 info("Stopping loading and confirming selection.");
                 connect(
                     m_carousel,
@@ -238,6 +270,29 @@ void MainWindow::onCancel() {
     close();
 }
 
+void MainWindow::_openPreview() {
+    const auto path = m_carousel->getCurrentImagePath();
+    if (path.isEmpty()) {
+        return;
+    }
+    if (!m_preview) {
+        m_preview = new ImagePreview(this);
+        connect(m_preview, &ImagePreview::closed, this, [this]() {
+            activateWindow();
+        });
+    }
+    info(QString("Previewing image: %1").arg(path));
+    m_preview->showFullScreen();
+    m_preview->open(path, m_carousel->getCurrentImagePixmap());
+    m_preview->activateWindow();
+}
+
+void MainWindow::showAndActivate() {
+    show();
+    raise();
+    activateWindow();
+}
+
 void MainWindow::_onImageFocused(const QString& path, const int index, const int count) {
     ui->topLabel->setText(QString("%1 (%2/%3)").arg(splitNameFromPath(path)).arg(index + 1).arg(count));
 }
@@ -253,6 +308,15 @@ void MainWindow::_onLoadingStarted(const qsizetype amount) {
 
 void MainWindow::_onLoadingCompleted(const qsizetype amount) {
     info(QString("Loading completed, loaded %1 images").arg(amount));
+    const auto cache = ThumbnailCache::instance();
+    if (cache->isEnabled()) {
+        LOG_INFO(QString("Thumbnail cache: %1 hits, %2 misses").arg(cache->getHits()).arg(cache->getMisses()), GeneralLogger::STEP);
+        cache->evictInBackground();
+    }
+    if (m_daemonMode) {
+        // the daemon may not exit for a long time
+        RejectedImageCache::instance()->save();
+    }
     ui->stackedWidget->setCurrentIndex(m_carouselIndex);
     m_state = Ready;
 }
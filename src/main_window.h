@@ -1,7 +1,7 @@
 /*
  * @Author: Uyanide pywang0608@foxmail.com
  * @Date: 2025-08-05 00:37:58
- * @LastEditTime: 2025-08-08 03:37:24
+ * @LastEditTime: 2026-10-22 11:15:48
  * @Description: MainWindow implementation.
  */
 #ifndef MAINWINDOW_H
@@ -10,7 +10,9 @@
 #include <QMainWindow>
 
 #include "config.h"
+#include "image_preview.h"
 #include "images_carousel.h"
+#include "library_watcher.h"
 #include "loading_indicator.h"
 
 QT_BEGIN_NAMESPACE
@@ -28,9 +30,13 @@ class MainWindow : public QMainWindow {
     MainWindow(const Config &config, QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Closing only hides the window, loading goes on in the background
+    void setDaemonMode(bool daemonMode) { m_daemonMode = daemonMode; }
+
   public slots:
     void onConfirm();
     void onCancel();
+    void showAndActivate();
 
   protected:
     void keyPressEvent(QKeyEvent *event) override;
@@ -38,6 +44,7 @@ class MainWindow : public QMainWindow {
 
   private:
     void _setupUI();
+    void _openPreview();
 
   private slots:
     void _onImageFocused(const QString &path, const int index, const int count);
@@ -58,8 +65,11 @@ class MainWindow : public QMainWindow {
     Ui::MainWindow *ui;
     ImagesCarousel *m_carousel           = nullptr;
     LoadingIndicator *m_loadingIndicator = nullptr;
+    LibraryWatcher *m_libraryWatcher     = nullptr;
+    ImagePreview *m_preview              = nullptr;  // created on first use
     int m_carouselIndex, m_loadingIndicatorIndex;
     const Config &m_config;
+    bool m_daemonMode = false;
 
   signals:
     void stop();
@@ -0,0 +1,83 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-19 15:08:51
+ * @LastEditTime: 2026-10-19 17:44:30
+ * @Description: Implementation of the rejected image cache.
+ */
+#include "rejected_image_cache.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+
+#include "config.h"
+#include "logger.h"
+using namespace GeneralLogger;
+
+RejectedImageCache* RejectedImageCache::instance() {
+    static RejectedImageCache cache;
+    return &cache;
+}
+
+RejectedImageCache::RejectedImageCache()
+    : m_filePath(Config::cacheDir() + QDir::separator() + "rejected") {
+}
+
+void RejectedImageCache::load() {
+    QMutexLocker locker(&m_mutex);
+    if (m_loaded) {
+        return;
+    }
+    m_loaded = true;
+
+    QFile file(m_filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;  // nothing rejected so far
+    }
+    QDataStream stream(&file);
+    quint32 magic = 0, version = 0;
+    QHash<QString, qint64> rejected;
+    stream >> magic >> version;
+    if (magic != s_magic || version != s_version) {
+        warn(QString("Ignoring incompatible rejected image cache: %1").arg(m_filePath));
+        return;
+    }
+    stream >> rejected;
+    if (stream.status() != QDataStream::Ok) {
+        warn(QString("Ignoring corrupted rejected image cache: %1").arg(m_filePath));
+        return;
+    }
+    m_rejected.swap(rejected);
+}
+
+void RejectedImageCache::save() {
+    QMutexLocker locker(&m_mutex);
+    if (!m_dirty) {
+        return;
+    }
+    QSaveFile file(m_filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        warn(QString("Failed to write rejected image cache: %1").arg(m_filePath));
+        return;
+    }
+    QDataStream stream(&file);
+    stream << s_magic << s_version << m_rejected;
+    if (!file.commit()) {
+        warn(QString("Failed to write rejected image cache: %1").arg(m_filePath));
+        return;
+    }
+    m_dirty = false;
+}
+
+bool RejectedImageCache::contains(const QString& path, qint64 mtimeNs) {
+    QMutexLocker locker(&m_mutex);
+    const auto it = m_rejected.constFind(path);
+    return it != m_rejected.cend() && it.value() == mtimeNs;
+}
+
+void RejectedImageCache::insert(const QString& path, qint64 mtimeNs) {
+    QMutexLocker locker(&m_mutex);
+    m_rejected.insert(path, mtimeNs);
+    m_dirty = true;
+}
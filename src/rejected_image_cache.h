@@ -0,0 +1,47 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-19 15:08:51
+ * @LastEditTime: 2026-10-26 10:52:08
+ * @Description: Persistent negative cache of files which are not valid images.
+ */
+#ifndef REJECTED_IMAGE_CACHE_H
+#define REJECTED_IMAGE_CACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+/**
+ * @brief Remembers files rejected by content sniffing or by a decode that failed on their content,
+ *        together with their mtime, so that they are skipped by later runs
+ *        until they are modified. All methods are thread-safe.
+ */
+class RejectedImageCache {
+  public:
+    static RejectedImageCache* instance();
+
+    void load();
+
+    // Only writes if anything changed
+    void save();
+
+    [[nodiscard]] bool contains(const QString& path, qint64 mtimeNs);
+
+    void insert(const QString& path, qint64 mtimeNs);
+
+  private:
+    RejectedImageCache();
+
+  private:
+    static constexpr quint32 s_magic   = 0x57435243;  // "WCRC"
+    static constexpr quint32 s_version = 1;
+
+    QString m_filePath;
+
+    QMutex m_mutex;  // for everything below
+    QHash<QString, qint64> m_rejected;
+    bool m_loaded = false;
+    bool m_dirty  = false;
+};
+
+#endif  // REJECTED_IMAGE_CACHE_H
@@ -0,0 +1,152 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-17 09:12:31
+ * @LastEditTime: 2026-10-25 11:26:40
+ * @Description: Implementation of the thumbnail cache.
+ */
+#include "thumbnail_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QThreadPool>
+
+#include "config.h"
+#include "logger.h"
+using namespace GeneralLogger;
+
+ThumbnailCache* ThumbnailCache::instance() {
+    static ThumbnailCache cache;
+    return &cache;
+}
+
+ThumbnailCache::ThumbnailCache() {
+    m_cacheDir = Config::cacheDir() + QDir::separator() + "thumbnails";
+    if (!QDir().mkpath(m_cacheDir)) {
+        warn(QString("Failed to create thumbnail cache directory: %1").arg(m_cacheDir));
+        m_cacheDir.clear();
+        m_enabled = false;
+    }
+}
+
+QString ThumbnailCache::Key::hash() const {
+    QCryptographicHash hasher(QCryptographicHash::Sha1);
+    hasher.addData(path.toUtf8());
+    hasher.addData(QString("\n%1\n%2\n%3\n%4x%5")
+                       .arg(inode)
+                       .arg(mtimeNs)
+                       .arg(size)
+                       .arg(target.width())
+                       .arg(target.height())
+                       .toUtf8());
+    return QString::fromLatin1(hasher.result().toHex());
+}
+
+ThumbnailCache::Key ThumbnailCache::makeKey(const QString& absolutePath, const QSize& target) {
+    Key key;
+    struct stat st{};
+    if (::stat(QFile::encodeName(absolutePath).constData(), &st) != 0) {
+        return key;
+    }
+    key.path    = absolutePath;
+    key.inode   = static_cast<quint64>(st.st_ino);
+    key.mtimeNs = static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec;
+    key.size    = static_cast<qint64>(st.st_size);
+    key.target  = target;
+    return key;
+}
+
+QString ThumbnailCache::_entryPath(const Key& key) const {
+    return m_cacheDir + QDir::separator() + key.hash() + ".thumb";
+}
+
+bool ThumbnailCache::contains(const Key& key) const {
+    if (!m_enabled || !key.isValid()) {
+        return false;
+    }
+    return ::access(QFile::encodeName(_entryPath(key)).constData(), F_OK) == 0;
+}
+
+bool ThumbnailCache::load(const Key& key, QImage& image) {
+    if (!m_enabled || !key.isValid()) {
+        return false;
+    }
+    const auto entryPath = _entryPath(key);
+    QImageReader reader(entryPath);
+    reader.setDecideFormatFromContent(true);
+    QImage cached;
+    if (!reader.read(&cached) || cached.size() != key.target) {
+        m_misses++;
+        return false;
+    }
+    // refresh mtime so that eviction works in LRU order
+    ::utimensat(AT_FDCWD, QFile::encodeName(entryPath).constData(), nullptr, 0);
+    image = std::move(cached);
+    m_hits++;
+    return true;
+}
+
+void ThumbnailCache::store(const Key& key, const QImage& image) {
+    if (!m_enabled || !key.isValid() || image.isNull()) {
+        return;
+    }
+    QSaveFile file(_entryPath(key));
+    if (!file.open(QIODevice::WriteOnly)) {
+        LOG_WARN(QString("Failed to open thumbnail cache entry for: %1").arg(key.path), GeneralLogger::DETAIL);
+        return;
+    }
+    // thumbnails are small, lossy compression is fine unless transparency is involved
+    QImageWriter writer(&file, image.hasAlphaChannel() ? "png" : "jpg");
+    writer.setQuality(90);
+    if (!writer.write(image) || !file.commit()) {
+        LOG_WARN(QString("Failed to write thumbnail cache entry for: %1").arg(key.path), GeneralLogger::DETAIL);
+    }
+}
+
+void ThumbnailCache::evictInBackground() {
+    if (!m_enabled) {
+        return;
+    }
+    QThreadPool::globalInstance()->start([this]() {
+        _evict();
+    });
+}
+
+void ThumbnailCache::_evict() {
+    QMutexLocker locker(&m_evictMutex);
+
+    // oldest first
+    const auto entries = QDir(m_cacheDir).entryInfoList(QDir::Files | QDir::NoDotAndDotDot,
+                                                        QDir::Time | QDir::Reversed);
+    qint64 total = 0;
+    for (const auto& entry : entries) {
+        total += entry.size();
+    }
+    const qint64 maxSize = m_maxSize;
+    if (total <= maxSize) {
+        return;
+    }
+
+    // evict a bit more than necessary so that this does not run on every launch
+    const qint64 targetSize = maxSize / 10 * 9;
+    int removed             = 0;
+    for (const auto& entry : entries) {
+        if (total <= targetSize) {
+            break;
+        }
+        if (QFile::remove(entry.absoluteFilePath())) {
+            total -= entry.size();
+            removed++;
+        }
+    }
+    info(QString("Evicted %1 thumbnail cache entries, %2 MiB remaining")
+             .arg(removed)
+             .arg(total / 1024 / 1024));
+}
@@ -0,0 +1,82 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-17 09:12:31
+ * @LastEditTime: 2026-10-25 11:26:40
+ * @Description: Persistent on-disk cache for cropped thumbnails.
+ */
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <atomic>
+
+/**
+ * @brief Persistent cache of pre-cropped thumbnails,
+ *        stored under $XDG_CACHE_HOME/wallpaper-carousel/thumbnails.
+ *        All methods are thread-safe.
+ */
+class ThumbnailCache {
+  public:
+    /**
+     * @brief Identifies a thumbnail. A changed source file (inode, mtime or size)
+     *        or a changed target size produces a different key.
+     */
+    struct Key {
+        QString path;
+        quint64 inode  = 0;
+        qint64 mtimeNs = 0;
+        qint64 size    = -1;
+        QSize target;
+
+        [[nodiscard]] bool isValid() const { return size >= 0 && target.isValid(); }
+
+        [[nodiscard]] QString hash() const;
+    };
+
+    static ThumbnailCache* instance();
+
+    // Stats the file, returns an invalid key on failure.
+    static Key makeKey(const QString& absolutePath, const QSize& target);
+
+    void setEnabled(bool enabled) { m_enabled = enabled && !m_cacheDir.isEmpty(); }
+
+    void setMaxSize(qint64 bytes) { m_maxSize = bytes; }
+
+    [[nodiscard]] bool isEnabled() const { return m_enabled; }
+
+    // Whether an entry exists, without reading it
+    [[nodiscard]] bool contains(const Key& key) const;
+
+    bool load(const Key& key, QImage& image);
+    void store(const Key& key, const QImage& image);
+
+    // Remove least recently used entries until the cache fits in its size cap.
+    void evictInBackground();
+
+    [[nodiscard]] int getHits() const { return m_hits; }
+
+    [[nodiscard]] int getMisses() const { return m_misses; }
+
+    static constexpr qint64 s_defaultMaxSize = 512ll * 1024 * 1024;
+
+  private:
+    ThumbnailCache();
+
+    [[nodiscard]] QString _entryPath(const Key& key) const;
+    void _evict();
+
+  private:
+    QString m_cacheDir;
+    std::atomic<bool> m_enabled{true};
+    std::atomic<qint64> m_maxSize{s_defaultMaxSize};
+
+    std::atomic<int> m_hits{0};
+    std::atomic<int> m_misses{0};
+
+    QMutex m_evictMutex;  // only one eviction pass at a time
+};
+
+#endif  // THUMBNAIL_CACHE_H
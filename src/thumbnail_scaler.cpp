@@ -0,0 +1,261 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-24 17:32:18
+ * @LastEditTime: 2026-10-24 17:32:18
+ * @Description: Implementation of the thumbnail downscaler.
+ */
+#include "thumbnail_scaler.h"
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define THUMBNAIL_SCALER_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Fixed point weights, the taps of one output pixel always add up to s_weightOne
+constexpr int s_weightBits   = 14;
+constexpr quint32 s_weightOne = 1u << s_weightBits;
+
+// Vertical sums are kept with 8 fractional bits between the passes
+constexpr int s_verticalShift   = s_weightBits - 8;
+constexpr int s_horizontalShift = s_weightBits + 8;
+
+/**
+ * Source pixels covered by each output pixel along one axis, with the covered
+ * fraction of each as weight. Output i covers [i * scale, (i + 1) * scale).
+ */
+struct Contributions {
+    std::vector<int> first;   // first source index
+    std::vector<int> count;   // number of taps
+    std::vector<int> offset;  // of the first tap in weights
+    std::vector<quint16> weights;
+    int maxCount = 0;
+};
+
+Contributions makeContributions(int sourceStart, int sourceLength, int targetLength) {
+    Contributions c;
+    c.first.resize(targetLength);
+    c.count.resize(targetLength);
+    c.offset.resize(targetLength);
+
+    const double scale = static_cast<double>(sourceLength) / targetLength;
+    std::vector<double> exact;
+    for (int i = 0; i < targetLength; i++) {
+        const double begin = i * scale;
+        const double end   = qMin((i + 1) * scale, static_cast<double>(sourceLength));
+        const int first    = static_cast<int>(std::floor(begin));
+        const int last     = qMin(sourceLength, static_cast<int>(std::ceil(end)));
+
+        exact.clear();
+        for (int j = first; j < last; j++) {
+            exact.push_back((qMin(end, j + 1.0) - qMax(begin, static_cast<double>(j))) / scale);
+        }
+
+        // round, then hand the rounding error to the largest tap
+        const int offset = static_cast<int>(c.weights.size());
+        int sum          = 0;
+        int largest      = 0;
+        for (int k = 0; k < static_cast<int>(exact.size()); k++) {
+            const int weight = static_cast<int>(std::lround(exact[k] * s_weightOne));
+            c.weights.push_back(static_cast<quint16>(weight));
+            sum += weight;
+            if (weight > c.weights[offset + largest]) {
+                largest = k;
+            }
+        }
+        c.weights[offset + largest] = static_cast<quint16>(c.weights[offset + largest] + static_cast<int>(s_weightOne) - sum);
+
+        c.first[i]  = sourceStart + first;
+        c.count[i]  = last - first;
+        c.offset[i] = offset;
+        c.maxCount  = qMax(c.maxCount, last - first);
+    }
+    return c;
+}
+
+// Weighted sum of count rows into one row of 16 bit values, length in bytes
+using VerticalFn = void (*)(const uchar* const* rows, const quint16* weights, int count, quint16* out, int length);
+
+// One row of 16 bit values into width 32 bit pixels
+using HorizontalFn = void (*)(const quint16* row, const Contributions& c, quint32* out, int width);
+
+void verticalScalar(const uchar* const* rows, const quint16* weights, int count, quint16* out, int length) {
+    for (int i = 0; i < length; i++) {
+        quint32 acc = 0;
+        for (int k = 0; k < count; k++) {
+            acc += weights[k] * rows[k][i];
+        }
+        out[i] = static_cast<quint16>((acc + (1u << (s_verticalShift - 1))) >> s_verticalShift);
+    }
+}
+
+void horizontalScalar(const quint16* row, const Contributions& c, quint32* out, int width) {
+    for (int x = 0; x < width; x++) {
+        const quint16* taps    = row + c.first[x] * 4;
+        const quint16* weights = c.weights.data() + c.offset[x];
+        quint32 acc[4]{};
+        for (int k = 0; k < c.count[x]; k++) {
+            for (int ch = 0; ch < 4; ch++) {
+                acc[ch] += weights[k] * taps[k * 4 + ch];
+            }
+        }
+        uchar pixel[4];
+        for (int ch = 0; ch < 4; ch++) {
+            pixel[ch] = static_cast<uchar>((acc[ch] + (1u << (s_horizontalShift - 1))) >> s_horizontalShift);
+        }
+        std::memcpy(out + x, pixel, sizeof(pixel));
+    }
+}
+
+#ifdef THUMBNAIL_SCALER_X86
+
+// 4 bytes, i.e. one pixel, at offset i of each row
+__attribute__((target("sse4.1"))) inline void verticalStepSse41(const uchar* const* rows,
+                                                                 const quint16* weights,
+                                                                 int count,
+                                                                 quint16* out,
+                                                                 int i) {
+    __m128i acc = _mm_setzero_si128();
+    for (int k = 0; k < count; k++) {
+        quint32 bytes;
+        std::memcpy(&bytes, rows[k] + i, sizeof(bytes));
+        const __m128i px = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(static_cast<int>(bytes)));
+        acc              = _mm_add_epi32(acc, _mm_mullo_epi32(px, _mm_set1_epi32(weights[k])));
+    }
+    acc = _mm_srli_epi32(_mm_add_epi32(acc, _mm_set1_epi32(1 << (s_verticalShift - 1))), s_verticalShift);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi32(acc, acc));
+}
+
+// length is always a whole number of pixels
+__attribute__((target("sse4.1"))) void verticalSse41(const uchar* const* rows,
+                                                      const quint16* weights,
+                                                      int count,
+                                                      quint16* out,
+                                                      int length) {
+    for (int i = 0; i < length; i += 4) {
+        verticalStepSse41(rows, weights, count, out, i);
+    }
+}
+
+__attribute__((target("sse4.1"))) void horizontalSse41(const quint16* row, const Contributions& c, quint32* out, int width) {
+    const __m128i round = _mm_set1_epi32(1 << (s_horizontalShift - 1));
+    for (int x = 0; x < width; x++) {
+        const quint16* taps    = row + c.first[x] * 4;
+        const quint16* weights = c.weights.data() + c.offset[x];
+        __m128i acc            = _mm_setzero_si128();
+        for (int k = 0; k < c.count[x]; k++) {
+            // the 4 channels of one source pixel
+            const __m128i px = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(taps + k * 4)));
+            acc              = _mm_add_epi32(acc, _mm_mullo_epi32(px, _mm_set1_epi32(weights[k])));
+        }
+        acc                 = _mm_srli_epi32(_mm_add_epi32(acc, round), s_horizontalShift);
+        const __m128i bytes = _mm_packus_epi16(_mm_packus_epi32(acc, acc), _mm_setzero_si128());
+        out[x]              = static_cast<quint32>(_mm_cvtsi128_si32(bytes));
+    }
+}
+
+__attribute__((target("avx2"))) void verticalAvx2(const uchar* const* rows,
+                                                   const quint16* weights,
+                                                   int count,
+                                                   quint16* out,
+                                                   int length) {
+    const __m256i round = _mm256_set1_epi32(1 << (s_verticalShift - 1));
+    int i               = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = 0; k < count; k++) {
+            const __m256i px = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[k] + i)));
+            acc              = _mm256_add_epi32(acc, _mm256_mullo_epi32(px, _mm256_set1_epi32(weights[k])));
+        }
+        acc = _mm256_srli_epi32(_mm256_add_epi32(acc, round), s_verticalShift);
+        // packing works per 128 bit lane, gather the two halves again
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(acc, acc), 0b1000);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_castsi256_si128(packed));
+    }
+    // an odd pixel at the end
+    for (; i < length; i += 4) {
+        verticalStepSse41(rows, weights, count, out, i);
+    }
+}
+
+#endif  // THUMBNAIL_SCALER_X86
+
+struct Kernel {
+    const char* name;
+    VerticalFn vertical;
+    HorizontalFn horizontal;
+};
+
+const Kernel& selectKernel() {
+    // WALLPAPER_CAROUSEL_SIMD=scalar|sse4.1 forces a smaller kernel, e.g. to compare them
+    static const Kernel kernel = []() -> Kernel {
+        const QByteArray forced = qgetenv("WALLPAPER_CAROUSEL_SIMD");
+#ifdef THUMBNAIL_SCALER_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && (forced.isEmpty() || forced == "avx2")) {
+            return {"avx2", verticalAvx2, horizontalSse41};
+        }
+        if (__builtin_cpu_supports("sse4.1") && forced != "scalar") {
+            return {"sse4.1", verticalSse41, horizontalSse41};
+        }
+#endif  // THUMBNAIL_SCALER_X86
+        Q_UNUSED(forced);
+        return {"scalar", verticalScalar, horizontalScalar};
+    }();
+    return kernel;
+}
+
+}  // namespace
+
+const char* ThumbnailScaler::kernelName() {
+    return selectKernel().name;
+}
+
+QImage ThumbnailScaler::downscale(const QImage& image, const QRect& sourceRect, const QSize& targetSize) {
+    QRect rect = sourceRect & image.rect();
+    if (image.isNull() || targetSize.isEmpty() || rect.width() < targetSize.width() || rect.height() < targetSize.height()) {
+        return {};
+    }
+
+    // 4 bytes per pixel, alpha premultiplied so that it can be averaged like the rest;
+    // converting only the region if needed
+    const auto format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+    QImage source     = image;
+    if (image.format() != format) {
+        source = image.copy(rect).convertToFormat(format);
+        rect.moveTo(0, 0);
+    }
+
+    const auto horizontal = makeContributions(0, rect.width(), targetSize.width());
+    const auto vertical   = makeContributions(rect.y(), rect.height(), targetSize.height());
+    const auto& kernel    = selectKernel();
+
+    QImage result(targetSize, format);
+    if (result.isNull()) {
+        return {};
+    }
+    std::vector<quint16> row(static_cast<size_t>(rect.width()) * 4);
+    std::vector<const uchar*> rows(vertical.maxCount);
+    for (int y = 0; y < targetSize.height(); y++) {
+        for (int k = 0; k < vertical.count[y]; k++) {
+            rows[k] = source.constScanLine(vertical.first[y] + k) + rect.x() * 4;
+        }
+        kernel.vertical(rows.data(),
+                        vertical.weights.data() + vertical.offset[y],
+                        vertical.count[y],
+                        row.data(),
+                        rect.width() * 4);
+        kernel.horizontal(row.data(),
+                          horizontal,
+                          reinterpret_cast<quint32*>(result.scanLine(y)),
+                          targetSize.width());
+    }
+    return result;
+}
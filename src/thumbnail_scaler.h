@@ -0,0 +1,30 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-24 17:32:18
+ * @LastEditTime: 2026-10-24 17:32:18
+ * @Description: Area-averaging downscaler for thumbnails.
+ */
+#ifndef THUMBNAIL_SCALER_H
+#define THUMBNAIL_SCALER_H
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+
+/**
+ * @brief Downscales a region of an image with an area-averaging (box) filter,
+ *        so that pixels outside the region are never touched. The inner loops use
+ *        AVX2 or SSE4.1 when the CPU has them, chosen once at runtime.
+ *        Can be safely used from any thread.
+ */
+class ThumbnailScaler {
+  public:
+    // sourceRect scaled to exactly targetSize. Only downscaling is supported,
+    // a null image is returned if sourceRect is smaller than targetSize in either direction.
+    static QImage downscale(const QImage& image, const QRect& sourceRect, const QSize& targetSize);
+
+    // "avx2", "sse4.1" or "scalar"
+    static const char* kernelName();
+};
+
+#endif  // THUMBNAIL_SCALER_H
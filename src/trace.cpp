@@ -0,0 +1,152 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-23 15:47:06
+ * @LastEditTime: 2026-10-23 15:47:06
+ * @Description: Implementation of span tracing.
+ */
+#include "trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QThread>
+#include <memory>
+#include <vector>
+
+#include "config.h"
+#include "logger.h"
+using namespace GeneralLogger;
+
+namespace {
+
+struct Event {
+    const char* name;
+    qint64 beginNs;
+    qint64 endNs;
+    QString path;
+};
+
+// Owned by one thread, the mutex is only ever contended by write()
+struct ThreadBuffer {
+    qint64 tid = 0;
+    QString threadName;
+    QMutex mutex;
+    std::vector<Event> events;
+};
+
+QElapsedTimer s_clock;
+QString s_filePath;
+
+QMutex s_registryMutex;  // for s_buffers
+std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;
+
+thread_local ThreadBuffer* t_buffer = nullptr;
+
+ThreadBuffer* threadBuffer() {
+    if (!t_buffer) {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->tid = static_cast<qint64>(::syscall(SYS_gettid));
+
+        const auto thread  = QThread::currentThread();
+        buffer->threadName = thread->objectName();
+        if (buffer->threadName.isEmpty()) {
+            const auto app     = QCoreApplication::instance();
+            buffer->threadName = app && app->thread() == thread ? "main" : "worker";
+        }
+
+        // buffers outlive their threads, pooled threads come and go
+        QMutexLocker locker(&s_registryMutex);
+        t_buffer = buffer.get();
+        s_buffers.push_back(std::move(buffer));
+    }
+    return t_buffer;
+}
+
+}  // namespace
+
+QString Trace::defaultFilePath() {
+    return Config::cacheDir() + QDir::separator() + "trace.json";
+}
+
+void Trace::start(const QString& filePath) {
+    s_filePath = filePath;
+    s_clock.start();
+    s_enabled = true;
+}
+
+qint64 Trace::now() {
+    return s_clock.nsecsElapsed();
+}
+
+void Trace::record(const char* name, qint64 beginNs, const QString& path) {
+    if (!isEnabled()) {
+        return;
+    }
+    const qint64 endNs = now();
+    const auto buffer  = threadBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    buffer->events.push_back({name, beginNs, endNs, path});
+}
+
+bool Trace::write() {
+    if (!s_enabled.exchange(false)) {
+        return false;
+    }
+
+    QFile file(s_filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        error(QString("Failed to write trace to %1").arg(s_filePath));
+        return false;
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    const auto writeEvent = [&file, first = true](const QJsonObject& event) mutable {
+        file.write(first ? "\n" : ",\n");
+        file.write(QJsonDocument(event).toJson(QJsonDocument::Compact));
+        first = false;
+    };
+
+    // streamed event by event, traces of large libraries get big
+    qsizetype count = 0;
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    QMutexLocker registryLocker(&s_registryMutex);
+    for (const auto& buffer : s_buffers) {
+        QMutexLocker locker(&buffer->mutex);
+        writeEvent({
+            {"name", "thread_name"},
+            {"ph", "M"},
+            {"pid", pid},
+            {"tid", buffer->tid},
+            {"args", QJsonObject{{"name", buffer->threadName}}},
+        });
+        for (const auto& event : buffer->events) {
+            QJsonObject object{
+                {"name", event.name},
+                {"cat", "pipeline"},
+                {"ph", "X"},
+                {"ts", event.beginNs / 1000.0},
+                {"dur", (event.endNs - event.beginNs) / 1000.0},
+                {"pid", pid},
+                {"tid", buffer->tid},
+            };
+            if (!event.path.isEmpty()) {
+                object.insert("args", QJsonObject{{"path", event.path}});
+            }
+            writeEvent(object);
+        }
+        count += static_cast<qsizetype>(buffer->events.size());
+        buffer->events.clear();
+    }
+    file.write("\n]}\n");
+    file.close();
+
+    info(QString("Wrote %1 trace events to %2").arg(count).arg(s_filePath));
+    return true;
+}
@@ -0,0 +1,87 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-23 15:47:06
+ * @LastEditTime: 2026-10-23 15:47:06
+ * @Description: Lightweight span tracing exported as Chrome trace events.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+
+/**
+ * @brief Collects timed spans per thread and writes them as Chrome trace-event JSON,
+ *        which can be opened in chrome://tracing or ui.perfetto.dev.
+ *        Disabled unless started, in which case a span costs a single atomic load.
+ *        All methods are thread-safe.
+ */
+class Trace {
+  public:
+    // $XDG_CACHE_HOME/wallpaper-carousel/trace.json
+    static QString defaultFilePath();
+
+    // Starts collecting, the events are written to filePath by write()
+    static void start(const QString& filePath);
+
+    // Stops collecting and writes everything collected so far
+    static bool write();
+
+    [[nodiscard]] static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // Nanoseconds since start()
+    [[nodiscard]] static qint64 now();
+
+    // A span from beginNs until now, for spans not bound to a scope, e.g. waiting in a queue
+    static void record(const char* name, qint64 beginNs, const QString& path = {});
+
+  private:
+    static inline std::atomic<bool> s_enabled{false};
+};
+
+/**
+ * @brief Records a span from construction to destruction, see TRACE_SPAN.
+ */
+class TraceSpan {
+  public:
+    explicit TraceSpan(const char* name)
+        : m_name(name), m_begin(Trace::isEnabled() ? Trace::now() : -1) {}
+
+    TraceSpan(const char* name, const QString& path)
+        : m_name(name), m_begin(Trace::isEnabled() ? Trace::now() : -1) {
+        if (m_begin >= 0) {
+            m_path = path;
+        }
+    }
+
+    // Local 8-bit path, only decoded when tracing
+    TraceSpan(const char* name, const QByteArray& path)
+        : m_name(name), m_begin(Trace::isEnabled() ? Trace::now() : -1) {
+        if (m_begin >= 0) {
+            m_path = QString::fromLocal8Bit(path);
+        }
+    }
+
+    ~TraceSpan() {
+        if (m_begin >= 0) {
+            Trace::record(m_name, m_begin, m_path);
+        }
+    }
+
+    TraceSpan(const TraceSpan&)            = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+  private:
+    const char* m_name;
+    const qint64 m_begin;
+    QString m_path;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b)      TRACE_CONCAT_IMPL(a, b)
+
+// Traces the rest of the enclosing scope: TRACE_SPAN("decode") or TRACE_SPAN("decode", path)
+#define TRACE_SPAN(...) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(__VA_ARGS__)
+
+#endif  // TRACE_H
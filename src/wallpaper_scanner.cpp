@@ -0,0 +1,202 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-18 18:02:44
+ * @LastEditTime: 2026-10-26 18:31:06
+ * @Description: Implementation of the wallpaper scanner.
+ */
+#include "wallpaper_scanner.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <QFile>
+#include <QThread>
+#include <utility>
+
+#include "config.h"
+#include "logger.h"
+#include "rejected_image_cache.h"
+#include "trace.h"
+using namespace GeneralLogger;
+
+static qint64 mtimeNs(const struct stat& st) {
+    return static_cast<qint64>(st.st_mtim.tv_sec) * 1000000000ll + st.st_mtim.tv_nsec;
+}
+
+// Reads only the leading bytes of the file
+static bool hasImageSignature(int dirFd, const char* name) {
+    const int fd = ::openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char header[Config::s_sniffSize];
+    const auto length = ::read(fd, header, sizeof(header));
+    ::close(fd);
+    return length > 0 && !Config::sniffImageFormat(QByteArray::fromRawData(header, static_cast<int>(length))).isEmpty();
+}
+
+WallpaperScanner::WallpaperScanner(int maxDepth, DirectoryIndex* index, int threadCount)
+    : m_maxDepth(qMax(0, maxDepth)), m_index(index) {
+    // mostly waiting for disks and network mounts, more threads than cores is fine
+    m_pool.setMaxThreadCount(threadCount > 0 ? threadCount : qMax(4, QThread::idealThreadCount()));
+}
+
+QStringList WallpaperScanner::scan(const QStringList& dirs) {
+    for (const auto& dir : dirs) {
+        const auto path = QFile::encodeName(dir);
+        m_pool.start([this, path]() { _scanDir(path, 0); });
+    }
+    m_pool.waitForDone();
+
+    QMutexLocker locker(&m_mutex);
+    return std::exchange(m_files, {});
+}
+
+QHash<QString, int> WallpaperScanner::getScannedDirs() {
+    QMutexLocker locker(&m_mutex);
+    return m_scannedDirs;
+}
+
+bool WallpaperScanner::_markVisited(quint64 dev, quint64 ino) {
+    QMutexLocker locker(&m_mutex);
+    const auto id = qMakePair(dev, ino);
+    if (m_visitedDirs.contains(id)) {
+        return false;
+    }
+    m_visitedDirs.insert(id);
+    return true;
+}
+
+void WallpaperScanner::_scanDir(const QByteArray& path, int depth) {
+    // stat before listing, so that changes made while listing are seen by the next scan
+    struct stat dirStat{};
+    if (::stat(path.constData(), &dirStat) != 0 || !S_ISDIR(dirStat.st_mode)) {
+        if (depth == 0) {
+            warn(QString("Directory '%1' does not exist").arg(QFile::decodeName(path)));
+        }
+        return;
+    }
+    // loop protection for symlinked directories
+    if (!_markVisited(dirStat.st_dev, dirStat.st_ino)) {
+        return;
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        m_scannedDirs.insert(QFile::decodeName(path), depth);
+    }
+
+    DirectoryIndex::DirEntry entry;
+    if (m_index && m_index->lookup(path, mtimeNs(dirStat), entry)) {
+        m_indexedCount++;
+    } else {
+        if (!_listDir(path, entry)) {
+            return;
+        }
+        entry.mtimeNs = mtimeNs(dirStat);
+        m_listedCount++;
+        if (m_index) {
+            m_index->update(path, entry);
+        }
+    }
+
+    const QByteArray prefix = path.endsWith('/') ? path : path + '/';
+    if (depth < m_maxDepth) {
+        for (const auto& subdir : entry.subdirs) {
+            const QByteArray subdirPath = prefix + subdir;
+            m_pool.start([this, subdirPath, depth]() { _scanDir(subdirPath, depth + 1); });
+        }
+    }
+
+    // rejected files are kept in the entry and dropped here, including those which failed
+    // to decode since they were indexed. A file fixed in place does not change the mtime
+    // of its directory, so the few rejected ones are checked again.
+    const auto rejected = RejectedImageCache::instance();
+    QStringList files;
+    files.reserve(entry.files.size());
+    for (const auto& file : entry.files) {
+        const auto filePath = QFile::decodeName(prefix + file.name);
+        if (!rejected->contains(filePath, file.mtimeNs) || _isFixed(prefix + file.name, filePath, file.mtimeNs)) {
+            files.append(filePath);
+        }
+    }
+    QMutexLocker locker(&m_mutex);
+    m_files.append(files);
+}
+
+bool WallpaperScanner::_isFixed(const QByteArray& path, const QString& filePath, qint64 indexedMtimeNs) {
+    struct stat st{};
+    if (::stat(path.constData(), &st) != 0 || mtimeNs(st) == indexedMtimeNs) {
+        return false;
+    }
+    const auto rejected = RejectedImageCache::instance();
+    if (rejected->contains(filePath, mtimeNs(st))) {
+        return false;
+    }
+    if (!hasImageSignature(AT_FDCWD, path.constData())) {
+        rejected->insert(filePath, mtimeNs(st));
+        return false;
+    }
+    return true;
+}
+
+bool WallpaperScanner::_listDir(const QByteArray& path, DirectoryIndex::DirEntry& entry) {
+    TRACE_SPAN("list_dir", path);
+    DIR* dir = ::opendir(path.constData());
+    if (!dir) {
+        LOG_WARN(QString("Failed to open directory: %1").arg(QFile::decodeName(path)), GeneralLogger::DETAIL);
+        return false;
+    }
+    const int fd        = ::dirfd(dir);
+    const auto rejected = RejectedImageCache::instance();
+
+    const QByteArray prefix = path.endsWith('/') ? path : path + '/';
+    while (const dirent* ent = ::readdir(dir)) {
+        const char* name = ent->d_name;
+        // hidden entries, including "." and "..", as QDir lists them by default
+        if (name[0] == '.') {
+            continue;
+        }
+
+        if (ent->d_type == DT_DIR) {
+            entry.subdirs.append(QByteArray(name));
+            continue;
+        }
+        if (ent->d_type != DT_REG && ent->d_type != DT_LNK && ent->d_type != DT_UNKNOWN) {
+            continue;
+        }
+        const bool validExtension = Config::hasValidExtension(QFile::decodeName(name));
+        if (ent->d_type == DT_REG && !validExtension) {
+            LOG_WARN(QString("Unsupported file type: %1").arg(QFile::decodeName(prefix + name)), GeneralLogger::DETAIL);
+            continue;
+        }
+
+        // the only stat of this entry, following symlinks
+        struct stat st{};
+        if (::fstatat(fd, name, &st, 0) != 0) {
+            continue;  // e.g. dangling symlink
+        }
+        if (S_ISDIR(st.st_mode)) {
+            entry.subdirs.append(QByteArray(name));
+        } else if (S_ISREG(st.st_mode) && validExtension) {
+            if (::faccessat(fd, name, R_OK, 0) != 0) {
+                LOG_WARN(QString("Invalid file: %1").arg(QFile::decodeName(prefix + name)), GeneralLogger::DETAIL);
+                continue;
+            }
+            // sniff the content, unless already known not to be an image.
+            // Rejected files are still indexed, _scanDir leaves them out.
+            const auto filePath = QFile::decodeName(prefix + name);
+            if (!rejected->contains(filePath, mtimeNs(st)) && !hasImageSignature(fd, name)) {
+                LOG_WARN(QString("Not a supported image: %1").arg(filePath), GeneralLogger::DETAIL);
+                rejected->insert(filePath, mtimeNs(st));
+            }
+            entry.files.append({QByteArray(name), static_cast<qint64>(st.st_size), mtimeNs(st)});
+        } else if (S_ISREG(st.st_mode)) {
+            LOG_WARN(QString("Unsupported file type: %1").arg(QFile::decodeName(prefix + name)), GeneralLogger::DETAIL);
+        }
+    }
+    ::closedir(dir);
+    return true;
+}
@@ -0,0 +1,69 @@
+/*
+ * @Author: Uyanide pywang0608@foxmail.com
+ * @Date: 2026-10-18 18:02:44
+ * @LastEditTime: 2026-10-26 10:52:08
+ * @Description: Parallel directory scanner for wallpapers.
+ */
+#ifndef WALLPAPER_SCANNER_H
+#define WALLPAPER_SCANNER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+
+#include "directory_index.h"
+
+/**
+ * @brief Lists image files in directories, walking subdirectories in parallel
+ *        up to a depth limit. File types are taken from the directory entries
+ *        and every entry is stat'ed at most once. Symlinked directories are
+ *        followed, each directory is visited only once. With an index, directories
+ *        whose mtime has not changed since the last scan are not listed at all.
+ *        Newly listed files are validated by their leading bytes, rejected ones
+ *        are remembered in RejectedImageCache.
+ */
+class WallpaperScanner {
+  public:
+    // maxDepth = 0 lists only the given directories themselves
+    explicit WallpaperScanner(int maxDepth, DirectoryIndex* index = nullptr, int threadCount = 0);
+
+    WallpaperScanner(const WallpaperScanner&)            = delete;
+    WallpaperScanner& operator=(const WallpaperScanner&) = delete;
+
+    // Blocks until all directories are scanned, results are unordered
+    QStringList scan(const QStringList& dirs);
+
+    [[nodiscard]] int getListedCount() const { return m_listedCount; }
+
+    [[nodiscard]] int getIndexedCount() const { return m_indexedCount; }
+
+    // Directories visited by scan() so far, with their depth below the scanned directory
+    [[nodiscard]] QHash<QString, int> getScannedDirs();
+
+  private:
+    void _scanDir(const QByteArray& path, int depth);
+    bool _listDir(const QByteArray& path, DirectoryIndex::DirEntry& entry);
+    // Whether a rejected file has been modified since it was indexed and now looks like an image
+    static bool _isFixed(const QByteArray& path, const QString& filePath, qint64 indexedMtimeNs);
+    bool _markVisited(quint64 dev, quint64 ino);
+
+  private:
+    const int m_maxDepth;
+    DirectoryIndex* m_index;
+    QThreadPool m_pool;
+
+    std::atomic<int> m_listedCount{0};
+    std::atomic<int> m_indexedCount{0};
+
+    QMutex m_mutex;  // for everything below
+    QStringList m_files;
+    QSet<QPair<quint64, quint64>> m_visitedDirs;  // (st_dev, st_ino)
+    QHash<QString, int> m_scannedDirs;
+};
+
+#endif  // WALLPAPER_SCANNER_H